@@ -0,0 +1,44 @@
+#include "compressionService.hpp"
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+
+static compression::CompressionService *service = nullptr;
+
+static void stopService(int)
+{
+    if (service)
+        service->stop();
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2 || argc > 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " <socket path> [workers]" << std::endl;
+        return 2;
+    }
+
+    try
+    {
+        compression::serviceOptions options;
+        if (argc == 3)
+            options.workers = std::strtoul(argv[2], nullptr, 10);
+
+        compression::CompressionService daemon(argv[1], options);
+        service = &daemon;
+        std::signal(SIGINT, stopService);
+        std::signal(SIGTERM, stopService);
+
+        std::cout << "Serving on " << argv[1] << std::endl;
+        daemon.run();
+        service = nullptr;
+    }
+    catch (const std::exception &ex)
+    {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
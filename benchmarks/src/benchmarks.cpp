@@ -0,0 +1,379 @@
+#include "dataProcessing.hpp"
+#include "fileReader.hpp"
+#include "frameFormat.hpp"
+#include "ransSimd.hpp"
+#include "tableFile.hpp"
+#include <benchmark/benchmark.h>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <random>
+#include <string>
+
+// Every stage is measured on the same series so the numbers add up: the
+// sample hourly file, the large exports when they are present (see
+// dataset/readMe.txt), and synthetic constant, random-walk and white-noise
+// series. Throughput is reported against the raw float bytes of the series.
+
+namespace
+{
+    constexpr size_t syntheticValues = 1 << 20;
+
+    struct csvSource
+    {
+        const char *name;
+        const char *path;
+        const char *column;
+        size_t columnIndex;
+    };
+
+    const csvSource csvSources[] = {
+        {"hourlyTemp", DATASET_DIR "/hourlyTemp.csv", nullptr, 1},
+        {"dataexport", DATASET_DIR "/largeVolume/dataexport_20250126T094958.csv", "Basel", 0},
+        {"cityTemperature", DATASET_DIR "/largeVolume/city_temperature.csv", "AvgTemperature", 0},
+    };
+
+    bool fileExists(const char *path)
+    {
+        return std::ifstream(path).good();
+    }
+
+    std::vector<float> readSource(const csvSource &source)
+    {
+        MappedCSVReader csv(source.path);
+        return source.column ? csv.readFloatColumnByName(source.column) : csv.readFloatColumn(source.columnIndex);
+    }
+
+    std::vector<float> synthetic(const std::string &shape)
+    {
+        std::mt19937 rng(42);
+        std::normal_distribution<float> noise(0.0f, 1.0f);
+        std::vector<float> values(syntheticValues);
+
+        float level = 20.0f;
+        for (auto &value : values)
+        {
+            if (shape == "constant")
+                value = 21.5f;
+            else if (shape == "randomWalk")
+                value = (level += 0.01f * std::round(noise(rng) * 10.0f));
+            else
+                value = noise(rng);
+        }
+        return values;
+    }
+
+    // Series are built once and shared by every benchmark.
+    std::map<std::string, std::vector<float>> &series()
+    {
+        static std::map<std::string, std::vector<float>> all;
+        return all;
+    }
+
+    void setThroughput(benchmark::State &state, size_t values)
+    {
+        state.SetBytesProcessed((int64_t)state.iterations() * values * sizeof(float));
+        state.counters["values/s"] = benchmark::Counter((double)state.iterations() * values, benchmark::Counter::kIsRate);
+    }
+
+    std::vector<uint8_t> fpcStage(const std::vector<float> &values,
+                                  compression::predictorSet predictors = compression::predictorSet::fcmDfcm)
+    {
+        auto codec = std::make_unique<compression::compressorDecompressor<float>>(predictors);
+        std::vector<uint8_t> fpc;
+        codec->encodeValues(values.data(), values.size(), fpc);
+        return fpc;
+    }
+
+    void BM_CsvParse(benchmark::State &state, csvSource source)
+    {
+        size_t values = 0;
+        for (auto _ : state)
+        {
+            std::vector<float> column = readSource(source);
+            values = column.size();
+            benchmark::DoNotOptimize(column.data());
+        }
+        setThroughput(state, values);
+    }
+
+    // FCM/DFCM prediction and residual packing run in one fused loop, so the
+    // FPC benchmarks time them together.
+    void BM_FpcEncode(benchmark::State &state, std::string name, compression::predictorSet predictors)
+    {
+        const auto &values = series()[name];
+        auto codec = std::make_unique<compression::compressorDecompressor<float>>(predictors);
+        std::vector<uint8_t> fpc(compression::compressorDecompressor<float>::fpcBound(values.size()));
+        size_t fpcSize = 0;
+        for (auto _ : state)
+        {
+            codec->reset();
+            fpcSize = codec->encodeValues(values.data(), values.size(), fpc.data());
+            benchmark::DoNotOptimize(fpc.data());
+        }
+        setThroughput(state, values.size());
+        state.counters["fpcBytes/value"] = (double)fpcSize / values.size();
+    }
+
+    void BM_FpcDecode(benchmark::State &state, std::string name, compression::predictorSet predictors)
+    {
+        const auto &values = series()[name];
+        std::vector<uint8_t> fpc = fpcStage(values, predictors);
+        auto codec = std::make_unique<compression::compressorDecompressor<float>>(predictors);
+        std::vector<float> output(values.size());
+        for (auto _ : state)
+        {
+            codec->reset();
+            codec->decodeValues(fpc.data(), fpc.size(), output.size(), output.data());
+            benchmark::DoNotOptimize(output.data());
+        }
+        setThroughput(state, values.size());
+    }
+
+    void BM_NormaliseFrequency(benchmark::State &state, std::string name)
+    {
+        const auto &values = series()[name];
+        std::vector<uint8_t> fpc = fpcStage(values);
+        RANS::SymbolStats counted;
+        counted.calculateFrequency(fpc);
+        for (auto _ : state)
+        {
+            RANS::SymbolStats stats = counted;
+            stats.normaliseFrequency(RANS::prob_scale);
+            benchmark::DoNotOptimize(stats.commulativeFrequency.data());
+        }
+        setThroughput(state, values.size());
+    }
+
+    void BM_RansEncode(benchmark::State &state, std::string name)
+    {
+        const auto &values = series()[name];
+        std::vector<uint8_t> fpc = fpcStage(values);
+        RANS::RANS rans(fpc);
+        size_t encodedSize = 0;
+        for (auto _ : state)
+        {
+            std::vector<uint8_t> encoded = rans.encodeInterleaved(RANS::defaultInterleave);
+            encodedSize = encoded.size();
+            benchmark::DoNotOptimize(encoded.data());
+        }
+        setThroughput(state, values.size());
+        state.counters["ransBytes/value"] = (double)encodedSize / values.size();
+    }
+
+    void BM_RansDecode(benchmark::State &state, std::string name, RANS::decodeKernel kernel)
+    {
+        if (kernel > RANS::bestDecodeKernel())
+        {
+            state.SkipWithError("decode kernel not supported by this CPU");
+            return;
+        }
+        const auto &values = series()[name];
+        std::vector<uint8_t> fpc = fpcStage(values);
+        RANS::RANS rans(fpc);
+        std::vector<uint8_t> encoded = rans.encodeInterleaved(RANS::defaultInterleave);
+
+        RANS::setDecodeKernel(kernel);
+        for (auto _ : state)
+        {
+            std::vector<uint8_t> decoded = rans.decodeInterleaved(encoded, fpc.size());
+            benchmark::DoNotOptimize(decoded.data());
+        }
+        RANS::setDecodeKernel(RANS::bestDecodeKernel());
+        setThroughput(state, values.size());
+    }
+
+    void BM_RoundTrip(benchmark::State &state, std::string name, compression::entropyBackend backend)
+    {
+        const auto &values = series()[name];
+        auto codec = std::make_unique<compression::compressorDecompressor<float>>();
+        codec->setEntropyBackend(backend);
+        size_t frameSize = 0;
+        for (auto _ : state)
+        {
+            std::vector<uint8_t> frame = codec->compress(values);
+            std::vector<float> output = codec->decompress(frame);
+            frameSize = frame.size();
+            benchmark::DoNotOptimize(output.data());
+        }
+        setThroughput(state, values.size());
+        state.counters["ratio"] = (double)values.size() * sizeof(float) / frameSize;
+    }
+
+    // Round trip with a fixed value codec, or with the one automatic picks
+    // (reported as its valueCodec number).
+    void BM_ValueCodec(benchmark::State &state, std::string name, compression::valueCodec valueCodec)
+    {
+        const auto &values = series()[name];
+        auto codec = std::make_unique<compression::compressorDecompressor<float>>();
+        codec->setValueCodec(valueCodec);
+        std::vector<uint8_t> frame(codec->compressBound(values.size()));
+        std::vector<float> output(values.size());
+        size_t frameSize = 0;
+        for (auto _ : state)
+        {
+            frameSize = codec->compress(values.data(), values.size(), frame.data(), frame.size());
+            codec->decompress(frame.data(), frameSize, output.data(), output.size());
+            benchmark::DoNotOptimize(output.data());
+        }
+        setThroughput(state, values.size());
+        state.counters["ratio"] = (double)values.size() * sizeof(float) / frameSize;
+        state.counters["codec"] = (double)compression::frameValueCodec(compression::parseFrame(frame.data(), frameSize).header.flags);
+    }
+
+    // compress() into one buffer of compressBound() bytes reused across calls.
+    void BM_CompressInto(benchmark::State &state, std::string name)
+    {
+        const auto &values = series()[name];
+        compression::compressorDecompressor<float> codec;
+        std::vector<uint8_t> buffer(codec.compressBound(values.size()));
+        size_t frameSize = 0;
+        for (auto _ : state)
+        {
+            frameSize = codec.compress(values.data(), values.size(), buffer.data(), buffer.size());
+            benchmark::DoNotOptimize(buffer.data());
+        }
+        setThroughput(state, values.size());
+        state.counters["ratio"] = (double)values.size() * sizeof(float) / frameSize;
+    }
+
+    // Many short per-sensor series, each with a fresh codec, where predictor
+    // table setup rather than coding dominates.
+    void BM_ShortSeries(benchmark::State &state)
+    {
+        const auto &walk = series()["randomWalk"];
+        std::vector<float> values(walk.begin(), walk.begin() + 256);
+        unsigned tableBits = (unsigned)state.range(0);
+        for (auto _ : state)
+        {
+            auto codec = std::make_unique<compression::compressorDecompressor<float>>(compression::predictorSet::fcmDfcm, tableBits);
+            std::vector<uint8_t> frame = codec->compress(values);
+            benchmark::DoNotOptimize(frame.data());
+        }
+        setThroughput(state, values.size());
+    }
+
+    // Gateway-style small batches through one long-lived codec and reused
+    // buffers, so only coding is measured, not setup or allocation.
+    void BM_SmallBatch(benchmark::State &state, compression::entropyBackend backend)
+    {
+        const auto &walk = series()["randomWalk"];
+        const size_t batch = 256;
+        compression::compressorDecompressor<float> codec;
+        codec.setEntropyBackend(backend);
+        std::vector<uint8_t> frame(codec.compressBound(batch));
+        std::vector<float> output(batch);
+        size_t offset = 0;
+        for (auto _ : state)
+        {
+            if (offset + batch > walk.size())
+                offset = 0;
+            size_t size = codec.compress(walk.data() + offset, batch, frame.data(), frame.size());
+            codec.decompress(frame.data(), size, output.data(), output.size());
+            benchmark::DoNotOptimize(output.data());
+            offset += batch;
+        }
+        setThroughput(state, batch);
+    }
+
+    // Scans a table of the random walk and its row numbers, in row groups of
+    // the default size, for the rows whose number lies in the first
+    // `percent` of the table; the footer statistics rule out the rest.
+    void BM_TableScan(benchmark::State &state)
+    {
+        const auto &walk = series()["randomWalk"];
+        std::string path = (std::filesystem::temp_directory_path() / "fpc_benchmark.tbl").string();
+        {
+            std::vector<float> rows(walk.size());
+            for (size_t row = 0; row < rows.size(); row++)
+                rows[row] = (float)row;
+            compression::TableWriter<float> writer(path, {"row", "value"});
+            writer.append({rows, walk});
+        }
+
+        compression::TableReader<float> reader(path);
+        float upper = (float)(walk.size() * state.range(0) / 100);
+        std::vector<compression::rangePredicate<float>> predicates = {{"row", 0.0f, upper - 1}};
+        size_t matched = 0;
+        for (auto _ : state)
+        {
+            auto columns = reader.scan({"value"}, predicates);
+            matched = columns[0].size();
+            benchmark::DoNotOptimize(columns[0].data());
+        }
+        setThroughput(state, walk.size());
+        state.counters["rowGroups"] = (double)reader.candidateRowGroups(predicates).size();
+        state.counters["matched"] = (double)matched;
+        std::filesystem::remove(path);
+    }
+
+    void registerSeries(const std::string &name, std::vector<float> values)
+    {
+        if (values.empty())
+            return;
+        series()[name] = std::move(values);
+
+        const std::pair<const char *, compression::predictorSet> predictorSets[] = {
+            {"fcmDfcm", compression::predictorSet::fcmDfcm},
+            {"stride", compression::predictorSet::stride},
+            {"extrapolating", compression::predictorSet::extrapolating},
+        };
+        for (const auto &set : predictorSets)
+        {
+            benchmark::RegisterBenchmark(("FpcEncode/" + name + "/" + set.first).c_str(), BM_FpcEncode, name, set.second);
+            benchmark::RegisterBenchmark(("FpcDecode/" + name + "/" + set.first).c_str(), BM_FpcDecode, name, set.second);
+        }
+        benchmark::RegisterBenchmark(("NormaliseFrequency/" + name).c_str(), BM_NormaliseFrequency, name);
+        benchmark::RegisterBenchmark(("RansEncode/" + name).c_str(), BM_RansEncode, name);
+        for (auto kernel : {RANS::decodeKernel::scalar, RANS::decodeKernel::sse41, RANS::decodeKernel::avx2})
+        {
+            benchmark::RegisterBenchmark(("RansDecode/" + name + "/" + RANS::decodeKernelName(kernel)).c_str(),
+                                         BM_RansDecode, name, kernel);
+        }
+        benchmark::RegisterBenchmark(("CompressInto/" + name).c_str(), BM_CompressInto, name);
+        benchmark::RegisterBenchmark(("RoundTrip/" + name + "/order0").c_str(), BM_RoundTrip, name,
+                                     compression::entropyBackend::order0);
+        benchmark::RegisterBenchmark(("RoundTrip/" + name + "/order0Compact").c_str(), BM_RoundTrip, name,
+                                     compression::entropyBackend::order0Compact);
+        benchmark::RegisterBenchmark(("RoundTrip/" + name + "/contextModel").c_str(), BM_RoundTrip, name,
+                                     compression::entropyBackend::contextModel);
+        benchmark::RegisterBenchmark(("RoundTrip/" + name + "/splitStreams").c_str(), BM_RoundTrip, name,
+                                     compression::entropyBackend::splitStreams);
+
+        const std::pair<const char *, compression::valueCodec> valueCodecs[] = {
+            {"raw", compression::valueCodec::raw},
+            {"xorBits", compression::valueCodec::xorBits},
+            {"fpcOnly", compression::valueCodec::fpcOnly},
+            {"automatic", compression::valueCodec::automatic},
+        };
+        for (const auto &codec : valueCodecs)
+            benchmark::RegisterBenchmark(("ValueCodec/" + name + "/" + codec.first).c_str(), BM_ValueCodec, name, codec.second);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    for (const auto &source : csvSources)
+    {
+        if (!fileExists(source.path))
+            continue;
+        benchmark::RegisterBenchmark((std::string("CsvParse/") + source.name).c_str(), BM_CsvParse, source);
+        registerSeries(source.name, readSource(source));
+    }
+    for (const char *shape : {"constant", "randomWalk", "whiteNoise"})
+        registerSeries(shape, synthetic(shape));
+
+    benchmark::RegisterBenchmark("ShortSeries", BM_ShortSeries)->Arg(10)->Arg(12)->Arg(16)->Arg(20);
+    benchmark::RegisterBenchmark("SmallBatch/order0", BM_SmallBatch, compression::entropyBackend::order0);
+    benchmark::RegisterBenchmark("SmallBatch/order0Compact", BM_SmallBatch, compression::entropyBackend::order0Compact);
+    benchmark::RegisterBenchmark("SmallBatch/contextModel", BM_SmallBatch, compression::entropyBackend::contextModel);
+    benchmark::RegisterBenchmark("SmallBatch/splitStreams", BM_SmallBatch, compression::entropyBackend::splitStreams);
+    benchmark::RegisterBenchmark("TableScan", BM_TableScan)->Arg(1)->Arg(10)->Arg(100);
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include "dataProcessing.hpp"
+#include "threadPool.hpp"
+
+// Block-indexed container, integers little endian:
+//
+//   magic "FPCB" | version u8 | frames | index | index size u32 | magic "FPCB"
+//
+// The index sits in a footer: block count varint, then per block its element
+// count and frame size as varints. Prefix sums give each block's first element
+// and byte offset, so a reader can seek to any element from the tail alone.
+// Every block is an independent frame (see frameFormat.hpp) with its own
+// predictor state and frequency table, so blocks compress and decompress in
+// parallel and any one of them decodes on its own.
+namespace compression
+{
+    constexpr uint32_t containerMagic = 0x42435046;
+    constexpr uint8_t containerVersion = 2;
+    constexpr size_t defaultBlockSize = 1 << 16;
+
+    struct blockIndex
+    {
+        // Block b holds elements [firstElement[b], firstElement[b + 1]) in bytes
+        // [offset[b], offset[b + 1]) of the container; both have one extra entry.
+        std::vector<uint64_t> firstElement;
+        std::vector<uint64_t> offset;
+
+        size_t blockCount() const { return firstElement.size() - 1; }
+        uint64_t elementCount() const { return firstElement.back(); }
+
+        // Block holding `element`; requires element < elementCount().
+        size_t blockOf(uint64_t element) const;
+    };
+
+    // Writes the container around already compressed block frames.
+    std::vector<uint8_t> buildContainer(const std::vector<std::vector<uint8_t>> &frames, const std::vector<uint64_t> &blockElements);
+
+    // Validates both magics and the footer; throws std::runtime_error on a bad container.
+    blockIndex readBlockIndex(const uint8_t *container, size_t size);
+
+    // Instantiated for the same value types as compressorDecompressor.
+    template <typename T = float>
+    class BlockCompressor
+    {
+    public:
+        // Uses `pool` when given, otherwise starts one sized to the machine.
+        explicit BlockCompressor(size_t blockSize = defaultBlockSize, ThreadPool *pool = nullptr);
+
+        void setEntropyBackend(entropyBackend backend) { this->backend = backend; }
+        // With valueCodec::automatic each block picks its own codec.
+        void setValueCodec(valueCodec codec) { this->codec = codec; }
+        void setPredictorSet(predictorSet predictors) { this->predictors = predictors; }
+        // Throws std::invalid_argument outside [minTableBits, maxTableBits].
+        void setTableBits(unsigned tableBits);
+        // Same rules as compressorDecompressor::setErrorBound().
+        void setErrorBound(errorBoundMode mode, double bound = 0);
+
+        // The codecs and frame buffers are kept from call to call, so run one
+        // call at a time on a BlockCompressor.
+        std::vector<uint8_t> compress(const std::vector<T> &input);
+        std::vector<T> decompress(const std::vector<uint8_t> &container);
+
+        // Decodes only the blocks covering elements [begin, end).
+        std::vector<T> decompressRange(const std::vector<uint8_t> &container, uint64_t begin, uint64_t end);
+
+    private:
+        size_t blockSize;
+        entropyBackend backend = entropyBackend::order0;
+        valueCodec codec = valueCodec::fpcEntropy;
+        predictorSet predictors = predictorSet::fcmDfcm;
+        unsigned tableBits = defaultTableBits;
+        errorBoundMode boundMode = errorBoundMode::lossless;
+        double bound = 0;
+        std::unique_ptr<ThreadPool> ownedPool;
+        ThreadPool *pool;
+
+        // Warm codec of one running task, with room for a block only partly
+        // inside a decoded range.
+        struct worker
+        {
+            compressorDecompressor<T> codec;
+            std::vector<T> partial;
+        };
+        std::mutex workerLock;
+        std::vector<std::unique_ptr<worker>> idleWorkers;
+        std::vector<std::vector<uint8_t>> frames;
+
+        std::unique_ptr<worker> takeWorker();
+        void returnWorker(std::unique_ptr<worker> idle);
+    };
+}
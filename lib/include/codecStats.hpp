@@ -0,0 +1,162 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Counters of the codec's hot paths, compiled in only when the library is
+// built with FPC_INSTRUMENTATION=1 (cmake -DFPC_INSTRUMENTATION=ON). Without
+// it every hook below folds away and the counters stay zero.
+//
+// The stages of a call report into the codecStats of the innermost
+// statsScope on the calling thread, so RANS and the frame code need no stats
+// argument threaded through them.
+#ifndef FPC_INSTRUMENTATION
+#define FPC_INSTRUMENTATION 0
+#endif
+
+namespace compression
+{
+    constexpr bool instrumentationEnabled = FPC_INSTRUMENTATION != 0;
+
+    enum class codecStage
+    {
+        fpcEncode,
+        fpcDecode,
+        histogram,
+        normalise,
+        symbolTables,
+        ransEncode,
+        ransDecode,
+        count
+    };
+
+    struct codecStats
+    {
+        struct stageCounters
+        {
+            uint64_t calls = 0;
+            uint64_t bytesIn = 0;
+            uint64_t bytesOut = 0;
+            // Time stamp counter ticks on x86, nanoseconds elsewhere.
+            uint64_t cycles = 0;
+        };
+
+        // Values coded with each predictor of the set, by index (0 FCM, 1 DFCM, ...).
+        uint64_t predictorHits[8] = {};
+        // Values by 3-bit zero-byte code; the last code of each word size means a zero residual.
+        uint64_t zeroByteCodes[8] = {};
+        stageCounters stages[(int)codecStage::count];
+
+        const stageCounters &stage(codecStage which) const { return stages[(int)which]; }
+
+        void merge(const codecStats &other)
+        {
+            for (int i = 0; i < 8; i++)
+            {
+                predictorHits[i] += other.predictorHits[i];
+                zeroByteCodes[i] += other.zeroByteCodes[i];
+            }
+            for (int i = 0; i < (int)codecStage::count; i++)
+            {
+                stages[i].calls += other.stages[i].calls;
+                stages[i].bytesIn += other.stages[i].bytesIn;
+                stages[i].bytesOut += other.stages[i].bytesOut;
+                stages[i].cycles += other.stages[i].cycles;
+            }
+        }
+    };
+
+    inline uint64_t readCycleCounter()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    // Stats of the innermost statsScope on this thread, or null.
+    inline codecStats *&activeStats()
+    {
+        static thread_local codecStats *active = nullptr;
+        return active;
+    }
+
+    // Routes the stages run on this thread into `target` for its lifetime.
+    // Nested scopes leave the outer one in charge, so a call made inside
+    // compress() is counted once.
+    class statsScope
+    {
+        codecStats *previous = nullptr;
+        bool outermost = false;
+
+    public:
+        explicit statsScope(codecStats &target)
+        {
+            if constexpr (instrumentationEnabled)
+            {
+                previous = activeStats();
+                outermost = previous == nullptr;
+                if (outermost)
+                    activeStats() = &target;
+            }
+        }
+
+        ~statsScope()
+        {
+            if constexpr (instrumentationEnabled)
+            {
+                if (outermost)
+                    activeStats() = previous;
+            }
+        }
+
+        bool isOutermost() const { return outermost; }
+
+        statsScope(const statsScope &) = delete;
+        statsScope &operator=(const statsScope &) = delete;
+    };
+
+    // Times one stage from construction to destruction. bytesOut can be set
+    // once the stage knows it.
+    class stageTimer
+    {
+        codecStats::stageCounters *counters = nullptr;
+        uint64_t start = 0;
+
+    public:
+        uint64_t bytesOut = 0;
+
+        stageTimer(codecStage stage, uint64_t bytesIn)
+        {
+            if constexpr (instrumentationEnabled)
+            {
+                if (codecStats *stats = activeStats())
+                {
+                    counters = &stats->stages[(int)stage];
+                    counters->calls++;
+                    counters->bytesIn += bytesIn;
+                    start = readCycleCounter();
+                }
+            }
+        }
+
+        ~stageTimer()
+        {
+            if constexpr (instrumentationEnabled)
+            {
+                if (counters)
+                {
+                    counters->cycles += readCycleCounter() - start;
+                    counters->bytesOut += bytesOut;
+                }
+            }
+        }
+
+        stageTimer(const stageTimer &) = delete;
+        stageTimer &operator=(const stageTimer &) = delete;
+    };
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include "dataProcessing.hpp"
+#include "fileReader.hpp"
+#include "threadPool.hpp"
+
+// Archive of named columns, integers little endian:
+//
+//   magic "FPCA" | version u8 | frames | directory | directory size u32 | magic "FPCA"
+//
+// The directory sits in a footer: column count varint, then per column its
+// name length varint, name bytes, element count varint and frame size varint.
+// Every column is one independent frame (see frameFormat.hpp), so columns are
+// compressed in parallel and a reader decodes only the ones it asks for.
+namespace compression
+{
+    constexpr uint32_t archiveMagic = 0x41435046;
+    constexpr uint8_t archiveVersion = 1;
+
+    struct columnEntry
+    {
+        std::string name;
+        uint64_t elementCount = 0;
+        // Byte range of the column's frame within the archive.
+        uint64_t offset = 0;
+        uint64_t size = 0;
+    };
+
+    // Writes the archive around already compressed column frames.
+    std::vector<uint8_t> buildArchive(const std::vector<std::string> &names, const std::vector<std::vector<uint8_t>> &frames,
+                                      const std::vector<uint64_t> &elementCounts);
+
+    // Validates both magics and the footer; throws std::runtime_error on a bad archive.
+    std::vector<columnEntry> readColumnDirectory(const uint8_t *archive, size_t size);
+
+    // Instantiated for the same value types as compressorDecompressor.
+    template <typename T = float>
+    class ColumnCompressor
+    {
+    public:
+        // Uses `pool` when given, otherwise starts one sized to the machine.
+        explicit ColumnCompressor(ThreadPool *pool = nullptr);
+
+        void setEntropyBackend(entropyBackend backend) { this->backend = backend; }
+        void setPredictorSet(predictorSet predictors) { this->predictors = predictors; }
+        // Throws std::invalid_argument outside [minTableBits, maxTableBits].
+        void setTableBits(unsigned tableBits);
+
+        // Column i is stored under names[i]; throws std::invalid_argument when the
+        // counts differ or a name repeats.
+        std::vector<uint8_t> compress(const std::vector<std::string> &names, const std::vector<std::vector<T>> &columns);
+
+    private:
+        entropyBackend backend = entropyBackend::order0;
+        predictorSet predictors = predictorSet::fcmDfcm;
+        unsigned tableBits = defaultTableBits;
+        std::unique_ptr<ThreadPool> ownedPool;
+        ThreadPool *pool;
+    };
+
+    // Reads the directory of an archive up front and decodes columns on demand.
+    // It does not copy the archive, which must outlive the reader.
+    template <typename T = float>
+    class ColumnArchive
+    {
+    public:
+        ColumnArchive(const uint8_t *archive, size_t size);
+        explicit ColumnArchive(const std::vector<uint8_t> &archive) : ColumnArchive(archive.data(), archive.size()) {}
+
+        const std::vector<columnEntry> &columns() const { return entries; }
+
+        // Index of the column called `name`; throws std::out_of_range when absent.
+        size_t columnIndex(const std::string &name) const;
+
+        std::vector<T> column(size_t index) const;
+        std::vector<T> column(const std::string &name) const { return column(columnIndex(name)); }
+
+    private:
+        const uint8_t *archive;
+        std::vector<columnEntry> entries;
+    };
+
+    // Parses the requested columns of `csv` in one pass and archives them under
+    // their header names, one value per data row so the columns stay aligned
+    // (missing and non-numeric cells become NaN). No names means every
+    // numeric column (MappedCSVReader::numericColumns()). Throws
+    // std::out_of_range for a name missing from the header.
+    std::vector<uint8_t> compressCsv(ColumnCompressor<float> &compressor, const MappedCSVReader &csv,
+                                     const std::vector<std::string> &names = {});
+}
@@ -0,0 +1,154 @@
+#pragma once
+#include "dataProcessing.hpp"
+#include "threadPool.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <string>
+#include <unordered_map>
+
+// Local compression service: compressorDecompressor behind a Unix-domain
+// stream socket, so collectors share warm coders instead of each paying the
+// table setup per call. Messages in both directions are, integers little endian:
+//
+//   length u32 (bytes after this field) | request id u32 | fields | body
+//
+// Requests carry op u8, value type u8 (as in frames), entropy backend u8 and
+// predictor set u8; the body is the raw values to compress or the frame to
+// decompress. Responses carry status u8 and the frame or the values, or an
+// error message. A client may pipeline requests; responses come back in
+// completion order, matched by id, and are dropped once the client closes.
+//
+// One event loop thread reads every client; the requests of a poll round are
+// batched across clients onto a worker pool whose tasks reuse warm coders.
+// Linux only (epoll).
+namespace compression
+{
+    enum class serviceOp : uint8_t
+    {
+        compress = 1,
+        decompress = 2
+    };
+
+    enum class serviceStatus : uint8_t
+    {
+        ok = 0,
+        error = 1
+    };
+
+    constexpr size_t serviceRequestHead = 4 + 4 + 4;
+    constexpr size_t serviceResponseHead = 4 + 4 + 1;
+
+    struct serviceOptions
+    {
+        size_t workers = std::thread::hardware_concurrency();
+        // Requests one worker task takes from a poll round; a round's requests
+        // from every client are split into tasks of at most this many.
+        size_t maxBatch = 64;
+        // Larger requests close the connection; larger responses become errors.
+        // A client is not read from while more than this many bytes of
+        // responses wait for it to read them.
+        size_t maxMessage = 64u << 20;
+    };
+
+    class CompressionService
+    {
+    public:
+        // Binds and listens on `socketPath`, replacing a stale socket there.
+        // Throws std::runtime_error when the socket cannot be set up.
+        explicit CompressionService(const std::string &socketPath, const serviceOptions &options = serviceOptions());
+        ~CompressionService();
+
+        CompressionService(const CompressionService &) = delete;
+        CompressionService &operator=(const CompressionService &) = delete;
+
+        // Serves until stop(), then waits for the requests in flight.
+        void run();
+        // Safe from any thread and from a signal handler.
+        void stop();
+
+    private:
+        struct request;
+        struct response;
+        struct connection;
+        struct workerContext;
+
+        std::string socketPath;
+        serviceOptions options;
+        int listenFd = -1;
+        int epollFd = -1;
+        int wakeFd = -1;
+        std::atomic<bool> stopping{false};
+
+        // Owned by the event loop and keyed by an id that is never reused, so a
+        // late response to a client that has gone is simply dropped.
+        std::unordered_map<uint64_t, std::unique_ptr<connection>> connections;
+        uint64_t nextConnection = 1;
+        // Requests read in the current poll round, from every client.
+        std::vector<request> batch;
+
+        ThreadPool pool;
+        std::mutex contextLock;
+        std::vector<std::unique_ptr<workerContext>> idleContexts;
+
+        std::mutex completedLock;
+        std::condition_variable allServed;
+        std::vector<response> completed;
+        size_t inFlight = 0;
+
+        void acceptClients();
+        // Reads what a client sent and queues its complete requests; false once
+        // it has closed or broken the protocol.
+        bool readRequests(uint64_t id, connection &client);
+        // Sends queued responses until the socket would block; false on error.
+        bool writeResponses(uint64_t id, connection &client);
+        // Polls a client for requests unless more than maxMessage bytes of
+        // responses wait for it to read them, and for writability while any wait.
+        void updateWatch(uint64_t id, connection &client);
+        void dropConnection(uint64_t id);
+        void dispatch();
+        void deliver();
+        void serve(std::vector<request> &requests);
+        void closeDescriptors();
+    };
+
+    struct serviceResponse
+    {
+        uint32_t id = 0;
+        serviceStatus status = serviceStatus::ok;
+        std::vector<uint8_t> body;
+    };
+
+    // Blocking client of one connection. Not thread safe; I/O errors and
+    // error responses throw std::runtime_error.
+    class ServiceClient
+    {
+    public:
+        explicit ServiceClient(const std::string &socketPath);
+        ~ServiceClient();
+
+        ServiceClient(const ServiceClient &) = delete;
+        ServiceClient &operator=(const ServiceClient &) = delete;
+
+        // Sends one request without waiting for its response; returns its id.
+        uint32_t send(serviceOp op, uint8_t valueType, entropyBackend backend, predictorSet predictors, const uint8_t *body,
+                      size_t size);
+        // Waits for the next response, whichever request it answers.
+        serviceResponse receive();
+
+        // One request each, answered before they return. Instantiated for the
+        // value types of compressorDecompressor.
+        template <typename T>
+        std::vector<uint8_t> compress(const std::vector<T> &values, entropyBackend backend = entropyBackend::order0,
+                                      predictorSet predictors = predictorSet::fcmDfcm);
+        template <typename T>
+        std::vector<T> decompress(const std::vector<uint8_t> &frame);
+
+    private:
+        int fd = -1;
+        uint32_t nextId = 1;
+
+        serviceResponse call(serviceOp op, uint8_t valueType, entropyBackend backend, predictorSet predictors, const uint8_t *body,
+                             size_t size);
+    };
+}
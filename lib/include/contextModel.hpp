@@ -0,0 +1,137 @@
+#pragma once
+#include "dataProcessing.hpp"
+
+// Context-modelled alternative to the single order-0 table of RANS::RANS. An
+// FPC stream interleaves header bytes with residual bytes whose statistics
+// depend on their significance: high residual bytes are skewed towards small
+// values while the low bytes are close to uniform. Following the stream
+// structure, every byte is coded with the static table of its context:
+//
+//   0       header byte
+//   1 + k   residual byte k, counted from the least significant one
+//
+// Tables use a 12-bit scale so all of them stay cache resident while decoding.
+namespace RANS
+{
+    constexpr uint32_t context_prob_bits = 12;
+    constexpr uint32_t context_prob_scale = 1 << context_prob_bits;
+    constexpr uint32_t maxContexts = 9;
+
+    // Names the context of the next byte of an FPC stream of `wordBytes`-byte
+    // words whose header bytes hold two tags (`paired`) or one. The encoder and
+    // the decoder advance it with every byte they code. The varint length of a
+    // run (see fpcMinRun) shares context 1 with the run's zero byte.
+    class fpcContextTracker
+    {
+        const uint8_t *lengths;
+        uint8_t runTag;
+        bool paired;
+        uint8_t length = 0;
+        uint8_t left = 0;
+        uint8_t queued = 0;
+        bool maybeRun = false;
+        bool queuedMaybeRun = false;
+        bool runLength = false;
+
+        void nextSlot()
+        {
+            length = left = queued;
+            maybeRun = queuedMaybeRun;
+            queued = 0;
+            queuedMaybeRun = false;
+        }
+
+    public:
+        fpcContextTracker(unsigned wordBytes, bool paired)
+            : lengths(wordBytes == 8 ? compression::residualLength64 : compression::residualLength32),
+              runTag(wordBytes == 8 ? compression::fpcTraits<uint64_t>::runCode : compression::fpcTraits<uint32_t>::runCode),
+              paired(paired)
+        {
+        }
+
+        uint32_t context() const
+        {
+            return runLength ? 1 : left == 0 ? 0 : 1 + (length - left);
+        }
+
+        void advance(uint8_t symbol)
+        {
+            if (runLength)
+            {
+                runLength = (symbol & 0x80) != 0;
+                if (!runLength)
+                    nextSlot();
+            }
+            else if (left == 0)
+            {
+                uint8_t first = paired ? symbol >> 4 : symbol;
+                length = left = lengths[first & 0x07];
+                maybeRun = first == runTag;
+                queued = paired ? lengths[symbol & 0x07] : 0;
+                queuedMaybeRun = paired && (symbol & 0x0f) == runTag;
+                if (left == 0)
+                    nextSlot();
+            }
+            else if (--left == 0)
+            {
+                if (maybeRun && symbol == 0)
+                    runLength = true;
+                else
+                    nextSlot();
+            }
+        }
+    };
+
+    // Splits an FPC stream into one byte stream per context: streams[c] gets,
+    // in order, the bytes fpcContextTracker puts in context c. `streams` ends
+    // up maxContexts long and keeps its storage from call to call.
+    void splitContextStreams(const uint8_t *fpc, size_t size, unsigned wordBytes, bool paired, vector<vector<uint8_t>> &streams);
+
+    // Inverse of splitContextStreams(): interleaves `streams` back into
+    // output[0, size). Throws std::runtime_error unless they hold exactly the
+    // bytes of such a stream.
+    void mergeContextStreams(const vector<vector<uint8_t>> &streams, unsigned wordBytes, bool paired, uint8_t *output, size_t size);
+
+    class ContextRANS
+    {
+        unsigned wordBytes;
+        bool paired;
+        const uint8_t *input = nullptr;
+        size_t inputSize = 0;
+        vector<uint8_t> contexts;
+        vector<SymbolStats> stats;
+        vector<uint8_t> cummulativeFreq2Symbol;
+        vector<decoderSymbol> decodingSymbols;
+
+        void initialiseSymbolTables();
+        // The slot-to-symbol tables only the decoder needs, built on first use.
+        void initialiseDecodingTables();
+
+    public:
+        // Counts every context in one pass over `input`, which must outlive the
+        // coder. `paired` as for fpcContextTracker.
+        ContextRANS(const uint8_t *input, size_t size, unsigned wordBytes, bool paired);
+        ContextRANS(const vector<uint8_t> &input, unsigned wordBytes, bool paired)
+            : ContextRANS(input.data(), input.size(), wordBytes, paired)
+        {
+        }
+
+        // Decoder-only model; contexts that never occur have an all-zero table.
+        ContextRANS(vector<SymbolStats> normalised, unsigned wordBytes, bool paired);
+
+        // Rebuild the coder as the matching constructor would, reusing the
+        // storage of every table.
+        void reset(const uint8_t *input, size_t size, unsigned wordBytes, bool paired);
+        void reset(const vector<SymbolStats> &normalised, unsigned wordBytes, bool paired);
+
+        // maxContexts normalised tables, indexed by context.
+        const vector<SymbolStats> &contextStats() const { return stats; }
+
+        // Same stream layout as RANS::encodeInterleaved().
+        vector<uint8_t> encodeInterleaved(uint32_t ways = defaultInterleave);
+        size_t encodeInterleaved(uint8_t *output, size_t capacity, uint32_t ways = defaultInterleave);
+
+        vector<uint8_t> decodeInterleaved(const uint8_t *encoded, size_t encodedSize, size_t original_size);
+        void decodeInterleaved(const uint8_t *encoded, size_t encodedSize, uint8_t *output, size_t original_size);
+    };
+}
@@ -6,6 +6,11 @@
 #include <cstdint>
 #include <memory>
 #include <cassert>
+#include <cmath>
+#include <type_traits>
+#include <functional>
+#include <stdexcept>
+#include "codecStats.hpp"
 
 using namespace std;
 
@@ -14,6 +19,15 @@ namespace RANS
     constexpr uint32_t lowerBound = 1u << 24;
     const uint32_t prob_bits = 16;
     const uint32_t prob_scale = 1 << prob_bits;
+    // Scale of compact order-0 tables: 4 KiB of symbol lookup instead of 64 KiB,
+    // at the price of coarser probabilities for rare symbols.
+    constexpr uint32_t compact_prob_bits = 12;
+
+    // Interleaved streams renormalise in 16-bit words so every state needs at
+    // most one refill per symbol, which keeps the lanes in lockstep.
+    constexpr uint32_t wordLowerBound = 1u << 16;
+    constexpr uint32_t maxInterleave = 8;
+    constexpr uint32_t defaultInterleave = 8;
 
     typedef struct
     {
@@ -36,6 +50,7 @@ namespace RANS
         vector<uint32_t> commulativeFrequency;
 
         void calculateFrequency(const vector<uint8_t> &inputArray);
+        void calculateFrequency(const uint8_t *input, size_t size);
         void calculateCummulativeFrequency();
         void normaliseFrequency(uint32_t totalTarget);
 
@@ -46,11 +61,18 @@ namespace RANS
 
     static void initialiseEncoderState(state *st);
 
-    static void normaliseEncoder(state *s, vector<uint8_t>::iterator &outputBuffer, uint32_t upperBound);
+    static void normaliseEncoder(state *s, uint8_t *&outputBuffer, uint32_t upperBound);
 
-    static void encoder(state *s, vector<uint8_t>::iterator &outputBuffer, uint32_t start, uint32_t frequency, uint32_t scaleBits);
+    static void encoder(state *s, uint8_t *&outputBuffer, uint32_t start, uint32_t frequency, uint32_t scaleBits);
 
-    static void encoderFlush(state *s, vector<uint8_t>::iterator &outputBuffer);
+    static inline void encoderFlush(state *s, uint8_t *&outputBuffer)
+    {
+        uint32_t x = *s;
+        outputBuffer -= 4;
+
+        for (int i = 0; i < 4; i++)
+            outputBuffer[i] = (uint8_t)(x >> (i * 8));
+    }
 
     static void initialiseDecoderState(state *s, vector<uint8_t>::iterator &outputBuffer);
 
@@ -77,11 +99,13 @@ namespace RANS
         }
         else
         {
-            uint32_t shift = 0;
-            while (frequency > (1u << shift))
-                shift++;
+            // Smallest shift with frequency <= 2^shift.
+            uint32_t shift = 32 - __builtin_clz(frequency - 1);
 
-            symb->frequencyInverse = (uint32_t)(((1ull << (shift + 31)) + frequency - 1) / frequency);
+            // ceil(2^(shift+31) / frequency). The quotient is below 2^32 and any
+            // fraction is at least 1/frequency, far above the rounding error of a
+            // double division, which pipelines where a 64-bit integer one does not.
+            symb->frequencyInverse = (uint32_t)std::ceil((double)(1ull << (shift + 31)) / frequency);
             symb->reciprocalShift = shift - 1;
             symb->bias = start;
         }
@@ -97,78 +121,406 @@ namespace RANS
         s->frequency = frequency;
     }
     
-    static inline void getSymbolFromEncoder(state *s, vector<uint8_t>::iterator &outputBuffer, encoderSymbol const *sym);
+    static inline void getSymbolFromEncoder(state *s, uint8_t *&outputBuffer, encoderSymbol const *sym);
 
     static inline void decoderWithSymbolTable(state *s, vector<uint8_t>::iterator &outputBuffer, decoderSymbol const *sym, uint32_t scaleBits);
 
+    static inline void initialiseWordDecoderState(state *s, const uint8_t *&inputBuffer)
+    {
+        uint32_t x = 0;
+        for (int i = 0; i < 4; i++)
+            x |= (uint32_t)inputBuffer[i] << (i * 8);
+        inputBuffer += 4;
+        *s = x;
+    }
+
+    static inline void wordEncoderWithSymbolTable(state *s, uint8_t *&outputBuffer, decoderSymbol const *sym, uint32_t scaleBits)
+    {
+        uint32_t x = *s;
+        uint32_t upperBound = ((wordLowerBound >> scaleBits) << 16) * sym->frequency;
+        if (x >= upperBound)
+        {
+            outputBuffer -= 2;
+            outputBuffer[0] = (uint8_t)(x & 0xff);
+            outputBuffer[1] = (uint8_t)((x >> 8) & 0xff);
+            x >>= 16;
+        }
+        *s = ((x / sym->frequency) << scaleBits) + (x % sym->frequency) + sym->start;
+    }
+
+    // Throws std::runtime_error rather than refill from past `inputEnd`.
+    static inline void wordDecoderWithSymbolTable(state *s, const uint8_t *&inputBuffer, const uint8_t *inputEnd, decoderSymbol const *sym,
+                                                  uint32_t scaleBits)
+    {
+        uint32_t mask = (1u << scaleBits) - 1;
+        uint32_t x = *s;
+
+        x = sym->frequency * (x >> scaleBits) + (x & mask) - sym->start;
+        if (x < wordLowerBound)
+        {
+            if (inputEnd - inputBuffer < 2)
+                throw std::runtime_error("rANS stream is truncated");
+            x = (x << 16) | (uint32_t)inputBuffer[0] | ((uint32_t)inputBuffer[1] << 8);
+            inputBuffer += 2;
+        }
+        *s = x;
+    }
+
+    // Worst case size of an interleaved stream: width byte, flushed states and
+    // at most one 16-bit word per symbol.
+    size_t interleavedBound(size_t symbolCount, uint32_t ways);
+
+    // Worst case size of an encode() stream: the flushed state and at most two
+    // bytes per symbol, since the smallest upper bound keeps 16 bits of state.
+    size_t streamBound(size_t symbolCount);
+
     vector<uint8_t> populateCummulativeFreq2Symbol(const SymbolStats &stats, uint32_t prob_scale);
+    // Fills `symbols` in place, reusing its storage.
+    void populateCummulativeFreq2Symbol(const SymbolStats &stats, uint32_t prob_scale, vector<uint8_t> &symbols);
 
     class RANS
     {
         
         SymbolStats stats;
+        uint32_t scaleBits = prob_bits;
         vector<uint8_t> cummulativeFreq2Symbol;
         vector<uint8_t> outputBuffer;
         vector<uint8_t> decodingBytes;
-        vector<uint8_t>::iterator rans_begin;
-        vector<uint8_t> inputArray;
+        const uint8_t *input = nullptr;
+        size_t inputSize = 0;
         vector<encoderSymbol> encodingSymbols;
         vector<decoderSymbol> decodingSymbols;
+        vector<uint32_t> decodingSlots;
         state rans;
-        vector<uint8_t>::iterator ptr;
 
-    public:
-        RANS(const vector<uint8_t> &input) : inputArray(input), encodingSymbols(256), decodingSymbols(256)
+        void initialiseSymbolTables()
         {
-            stats.calculateFrequency(inputArray);
-            stats.normaliseFrequency(prob_scale);
-
-            cummulativeFreq2Symbol = populateCummulativeFreq2Symbol(stats, prob_scale);
-
-            // Dynamically size outputBuffer based on input
-            outputBuffer.resize(1 << 20); // Generous estimate for encoded size
-            decodingBytes.resize(inputArray.size());
-
+            compression::stageTimer timer(compression::codecStage::symbolTables, 0);
             for (int i = 0; i < 256; i++)
             {
-                encodingSymbolInitialise(&encodingSymbols[i], stats.commulativeFrequency[i],
-                                         stats.commulativeFrequency[i + 1] - stats.commulativeFrequency[i], prob_bits);
+                // Reciprocals cost a division each; a decoder-only model has no use for them.
+                if (input)
+                    encodingSymbolInitialise(&encodingSymbols[i], stats.commulativeFrequency[i],
+                                             stats.commulativeFrequency[i + 1] - stats.commulativeFrequency[i], scaleBits);
 
                 decodingSymbolInitialise(&decodingSymbols[i], stats.commulativeFrequency[i],
                                          stats.commulativeFrequency[i + 1] - stats.commulativeFrequency[i]);
             }
         }
 
+        // The slot-to-symbol table only the decoder needs, built on first use.
+        void initialiseDecodingTables()
+        {
+            if (!cummulativeFreq2Symbol.empty())
+                return;
+            compression::stageTimer timer(compression::codecStage::symbolTables, 0);
+            populateCummulativeFreq2Symbol(stats, 1u << scaleBits, cummulativeFreq2Symbol);
+            // Padding for the 32-bit gathers of the SIMD decoder.
+            cummulativeFreq2Symbol.resize((1u << scaleBits) + 3);
+        }
+
+        static uint32_t checkedScaleBits(uint32_t scaleBits)
+        {
+            if (scaleBits < 8 || scaleBits > prob_bits)
+                throw std::invalid_argument("rANS scale must be between 8 and 16 bits");
+            return scaleBits;
+        }
+
+    public:
+        // Counts `input`, which must outlive the coder, and normalises the
+        // frequencies to 2^scaleBits, 8 to 16 bits.
+        RANS(const uint8_t *input, size_t size, uint32_t scaleBits = prob_bits) : encodingSymbols(256), decodingSymbols(256)
+        {
+            reset(input, size, scaleBits);
+        }
+
+        RANS(const vector<uint8_t> &input, uint32_t scaleBits = prob_bits) : RANS(input.data(), input.size(), scaleBits) {}
+        // The coder keeps a pointer to its input, so a temporary would dangle.
+        RANS(vector<uint8_t> &&input, uint32_t scaleBits = prob_bits) = delete;
+
+        // Decoder-only model rebuilt from a normalised table, e.g. one read from a frame.
+        explicit RANS(const SymbolStats &normalised, uint32_t scaleBits = prob_bits) : encodingSymbols(256), decodingSymbols(256)
+        {
+            reset(normalised, scaleBits);
+        }
+
+        // Rebuild the coder as the matching constructor would, reusing the
+        // storage of every table, so a long-lived coder allocates nothing.
+        void reset(const uint8_t *input, size_t size, uint32_t scaleBits = prob_bits);
+        void reset(const SymbolStats &normalised, uint32_t scaleBits = prob_bits);
+
+        const SymbolStats &symbolStats() const { return stats; }
+
+        // Single-state stream of at most streamBound() bytes. The output buffer
+        // grows to the largest stream coded so far and is reused.
         vector<uint8_t> encode();
 
         vector<uint8_t> decode(vector<uint8_t> &encoded, size_t original_size);
+
+        // ways independent states (2, 4 or 8) share one stream; symbol i belongs
+        // to state i % ways and the width is stored in the first byte.
+        vector<uint8_t> encodeInterleaved(uint32_t ways = defaultInterleave);
+
+        // Same stream, coded backwards into the end of output[0, capacity) so
+        // nothing is copied: it starts at output + capacity - the returned size.
+        // Throws std::invalid_argument when capacity is below interleavedBound().
+        size_t encodeInterleaved(uint8_t *output, size_t capacity, uint32_t ways = defaultInterleave);
+
+        vector<uint8_t> decodeInterleaved(const vector<uint8_t> &encoded, size_t original_size);
+
+        vector<uint8_t> decodeInterleaved(const uint8_t *encoded, size_t encodedSize, size_t original_size);
+
+        // Writes the original_size decoded bytes to `output`.
+        void decodeInterleaved(const uint8_t *encoded, size_t encodedSize, uint8_t *output, size_t original_size);
     };
 }
 
 namespace compression
 {
+    // Residual bytes stored for each 3-bit zero-byte code of a 64- or 32-bit word.
+    constexpr uint8_t residualLength64[8] = {8, 7, 6, 5, 3, 2, 1, 0};
+    constexpr uint8_t residualLength32[8] = {4, 3, 2, 1, 0, 0, 0, 0};
+
+    // Compile-time layout of the FPC stage for a value type: the word the
+    // predictors work on, the hash shifts that keep the top 16 (FCM) and 24
+    // (DFCM) bits of a word, and the 3-bit leading-zero-byte code. 64-bit
+    // words cannot express 4 zero bytes (8 counts, 8 codes), 32-bit words
+    // use codes 0..4 directly.
+    template <typename T>
+    struct fpcTraits
+    {
+        static_assert(sizeof(T) == 4 || sizeof(T) == 8, "FPC codes 32- or 64-bit values");
+
+        using word = typename std::conditional<sizeof(T) == 4, uint32_t, uint64_t>::type;
+        static constexpr unsigned wordBytes = sizeof(word);
+        static constexpr unsigned wordBits = wordBytes * 8;
+        static constexpr unsigned fcmShift = wordBits - 16;
+        static constexpr unsigned dfcmShift = wordBits - 24;
+        static constexpr uint8_t zeroResidualCode = wordBytes == 8 ? 7 : 4;
+        // Code of a one-byte residual, whose byte is never zero.
+        static constexpr uint8_t runCode = wordBytes == 8 ? 6 : 3;
+        static constexpr const uint8_t *residualLength = wordBytes == 8 ? residualLength64 : residualLength32;
+    };
+
+    // A run of repeats of the previous value is stored as the tag of predictor
+    // 0 with runCode, a zero residual byte and a varint n: fpcMinRun + n more
+    // copies. The coder shows the predictors fpcMinRun of them whatever the
+    // length, which leaves every predictor as the whole run would.
+    constexpr size_t fpcMinRun = 16;
+
+    // Value type tag stored in frames.
+    template <typename T>
+    struct valueTypeCode;
+    template <>
+    struct valueTypeCode<float> : std::integral_constant<uint8_t, 0>
+    {
+    };
+    template <>
+    struct valueTypeCode<double> : std::integral_constant<uint8_t, 1>
+    {
+    };
+    template <>
+    struct valueTypeCode<uint32_t> : std::integral_constant<uint8_t, 2>
+    {
+    };
+    template <>
+    struct valueTypeCode<uint64_t> : std::integral_constant<uint8_t, 3>
+    {
+    };
 
+    // Entropy stage of a frame: one order-0 table over the whole FPC stream, or
+    // separate tables for headers and each residual byte position, either in
+    // one stream or one stream each.
+    enum class entropyBackend
+    {
+        order0,
+        contextModel,
+        // order0 with a 12-bit table: cache-resident decode tables and a cheaper
+        // setup for small blocks, slightly worse ratio on skewed streams.
+        order0Compact,
+        // The contexts of contextModel as separate order-0 streams: most of its
+        // ratio gain, decoded with the SIMD kernels.
+        splitStreams
+    };
+
+    // How compress() codes the values of a frame: FPC followed by the entropy
+    // backend, the FPC bytes as they are, the values as they are, or XOR bit
+    // packing (see xorCodec.hpp). automatic estimates each on a sample of the
+    // call's values and keeps the smallest, though a costlier codec must save
+    // over 1/32 of the cheaper one's size to be picked. Frames record the codec.
+    enum class valueCodec : uint8_t
+    {
+        fpcEntropy,
+        fpcOnly,
+        raw,
+        xorBits,
+        automatic
+    };
+
+    // Predictors an FPC stage chooses between for every value (see
+    // predictors.hpp). Frames record the set. fcmDfcm packs two 4-bit tags per
+    // header byte; the larger sets spend one tag byte per value: the predictor
+    // index above the 3-bit zero-byte code.
+    enum class predictorSet : uint8_t
+    {
+        fcmDfcm,       // FCM, DFCM
+        stride,        // + last value, 2-delta stride
+        extrapolating, // + linear and quadratic extrapolation
+    };
+
+    // Predictor tables hold 2^tableBits slots. Small tables stay in cache and
+    // suit short series; frames record the size.
+    constexpr unsigned minTableBits = 10;
+    constexpr unsigned maxTableBits = 20;
+    constexpr unsigned defaultTableBits = 16;
+
+    // Throws std::runtime_error for an id no predictor set is registered under.
+    predictorSet predictorSetFromCode(uint8_t code);
+
+    // Whether the FPC stream of `set` packs two tags per header byte.
+    inline bool pairedTags(predictorSet set) { return set == predictorSet::fcmDfcm; }
+
+    // How far compress() may move a value to clear low mantissa bits for the
+    // predictors: not at all, by at most a fixed amount, or by at most a
+    // fraction of the value's magnitude.
+    enum class errorBoundMode
+    {
+        lossless,
+        absolute,
+        relative
+    };
+
+    template <typename T>
+    class fpcCoder;
+    class FrameContext;
+    struct frameView;
+
+    // Instantiated for float, double, uint32_t and uint64_t.
+    template <typename T = float>
     class compressorDecompressor
     {
     public:
-        std::pair<std::vector<uint8_t>,size_t> compress(const std::vector<float> &input);
-        std::vector<float> decompress(std::vector<uint8_t> &compressed, size_t originalSize,size_t compressedSize);
+        using word = typename fpcTraits<T>::word;
+
+        // Throws std::invalid_argument for tableBits outside [minTableBits, maxTableBits].
+        explicit compressorDecompressor(predictorSet predictors = predictorSet::fcmDfcm, unsigned tableBits = defaultTableBits);
+        ~compressorDecompressor();
+
+        // Returns a self-describing frame (see frameFormat.hpp) that any
+        // compressorDecompressor of the same value type can decode on its own.
+        std::vector<uint8_t> compress(const std::vector<T> &input);
+
+        // Largest frame compress() can return for `count` values.
+        static size_t compressBound(size_t count);
+
+        // Same frame, written to the start of output[0, capacity); returns its
+        // size. A buffer of compressBound(count) bytes always suffices. Throws
+        // std::invalid_argument when capacity is too small.
+        //
+        // The object is the long-lived context for a run of calls: it keeps its
+        // predictor tables, entropy coders, decoder cache and scratch buffers, so
+        // the pointer forms of compress() and decompress() allocate nothing once
+        // the largest batch has been seen. Use one per thread.
+        size_t compress(const T *input, size_t count, uint8_t *output, size_t capacity);
+
+        std::vector<T> decompress(const std::vector<uint8_t> &frame);
+        std::vector<T> decompress(const uint8_t *frame, size_t size);
+        // Decodes into output[0, capacity) and returns the element count; throws
+        // std::invalid_argument when the frame holds more than capacity values.
+        size_t decompress(const uint8_t *frame, size_t size, T *output, size_t capacity);
+
+        // Backend used by compress(); frames record it, so decompress() reads either.
+        void setEntropyBackend(entropyBackend backend) { this->backend = backend; }
+        entropyBackend getEntropyBackend() const { return backend; }
+
+        // Codec used by compress(); decompress() reads every codec.
+        void setValueCodec(valueCodec codec) { this->codec = codec; }
+        valueCodec getValueCodec() const { return codec; }
+
+        // Set used by compress() and the FPC stage calls below. Changing it
+        // starts a new series; decompress() follows whatever its frame records.
+        void setPredictorSet(predictorSet predictors);
+        predictorSet getPredictorSet() const { return predictors; }
+
+        // Same rules as the predictor set.
+        void setTableBits(unsigned tableBits);
+        unsigned getTableBits() const { return tableBits; }
+
+        // Lets compress() round each float to the fewest mantissa bits that stay
+        // within `bound` of it; NaN, infinities and zero pass unchanged. Frames
+        // are marked lossy but decode as usual. Only the encodeValues() stage
+        // calls stay lossless. Throws std::invalid_argument for a negative or
+        // NaN bound, or for a lossy mode on integer value types.
+        void setErrorBound(errorBoundMode mode, double bound = 0);
+        errorBoundMode getErrorBoundMode() const { return boundMode; }
+        double getErrorBound() const { return bound; }
+
+        // Counters of the calls on this object since the last resetStats(). They
+        // stay zero unless the library is built with FPC_INSTRUMENTATION.
+        const codecStats &getStats() const { return stats; }
+        void resetStats() { stats = codecStats(); }
+
+        // Called with the counters of each compress(), decompress() and FPC stage
+        // call once it returns; only in instrumented builds.
+        void setStatsCallback(std::function<void(const codecStats &)> callback) { statsCallback = std::move(callback); }
+
+        // Worst-case FPC stage output for `count` values with any predictor set, slack included.
+        static size_t fpcBound(size_t count);
+
+        // FPC stage only. Both continue from the current predictor state, so
+        // consecutive calls code one long series; reset() starts a new one.
+        // The pointer form of encodeValues() writes into a caller buffer of
+        // fpcBound(count) bytes and returns the bytes used; neither path
+        // allocates per value.
+        size_t encodeValues(const T *input, size_t count, uint8_t *output);
+        void encodeValues(const T *input, size_t count, std::vector<uint8_t> &compressed);
+        void decodeValues(const uint8_t *fpcCpmpreesed, size_t fpcSize, size_t originalSize, T *output);
+        void reset();
 
     private:
-        RANS::RANS *rans = nullptr;
-        const static uint32_t TABLE_SIZE = 1 << 16;
-        uint64_t fcm[TABLE_SIZE] = {0};
-        uint64_t dfcm[TABLE_SIZE] = {0};
-        uint32_t fcm_hash = 0;
-        uint32_t dfcm_hash = 0;
-        uint64_t last_value = 0;
-
-        uint64_t getFcmPrediction();
-        uint64_t getDfcmPrediction();
-        void reset();
-        void updateFcmHash(uint64_t true_value);
-        void updateDfcmHash(uint64_t true_value);
-        static uint8_t encodeZeroBytes(uint64_t diff);
-        uint64_t toLong(const std::vector<uint8_t> &dst);
+        predictorSet predictors;
+        unsigned tableBits;
+        entropyBackend backend = entropyBackend::order0;
+        valueCodec codec = valueCodec::fpcEntropy;
+        errorBoundMode boundMode = errorBoundMode::lossless;
+        double bound = 0;
+        std::unique_ptr<fpcCoder<T>> coder;
+        // Coders of the frames decompress() has seen, most recent first; kept
+        // apart from `coder` so decoding never disturbs the encode state.
+        std::vector<std::unique_ptr<fpcCoder<T>>> frameCoders;
+        codecStats stats;
+        std::function<void(const codecStats &)> statsCallback;
+        std::unique_ptr<FrameContext> frames;
+        std::vector<uint8_t> fpcScratch;
+        std::vector<T> roundedScratch;
+        std::vector<uint8_t> xorScratch;
+        // Codes the samples of valueCodec::automatic with small tables.
+        std::unique_ptr<fpcCoder<T>> samplingCoder;
+        std::vector<T> sampleScratch;
+        std::vector<uint8_t> sampleFpc;
+
+        // `input`, or in a lossy mode a rounded copy of it, adding frameFlagLossy to `flags`.
+        const T *boundedValues(const T *input, size_t count, uint8_t &flags);
+        // Resets the predictors and codes `values` into fpcScratch; returns the FPC size.
+        size_t compressFpc(const T *values, size_t count);
+        // Estimates every codec on a sample of `values`. When the sample is all
+        // of them, fpcScratch is left holding their FPC stream of `fpcSize` bytes.
+        valueCodec chooseCodec(const T *values, size_t count, size_t &fpcSize);
+        // Writes the frame of `values` coded with `chosen`; `fpcSize` is that of
+        // fpcScratch when it already holds their FPC stream, otherwise zero.
+        size_t encodeFrameAs(valueCodec chosen, const T *values, size_t count, uint8_t flags, size_t fpcSize, uint8_t *output,
+                             size_t capacity);
+        // Parses `frame` and checks it holds values of type T.
+        const frameView &parseValueFrame(const uint8_t *frame, size_t size);
+        void decodeFrameValues(const frameView &view, T *output);
+
+        // Runs `body` with its stages counted into `stats`, when instrumented.
+        template <typename F>
+        auto instrumented(F &&body) -> decltype(body());
+
+        // The coder for `set` and `bits`, rebuilt with fresh state when either changes.
+        fpcCoder<T> &coderFor(predictorSet set, unsigned bits);
+        // A coder for decoding a frame of `set` and `bits`, from frameCoders.
+        fpcCoder<T> &frameCoderFor(predictorSet set, unsigned bits);
     };
 }
\ No newline at end of file
@@ -25,4 +25,46 @@ public:
 // Function to convert a vector of strings to a vector of floats
 std::vector<float>convertToFloat(const std::vector<std::string> &stringColumn);
 
+// Read-only view of a CSV file mapped into memory. Columns are parsed straight
+// from the mapping into floats; nothing is stored for the cells that are not
+// requested. The first line is the header.
+class MappedCSVReader
+{
+private:
+    std::string filename;
+    const char *begin = nullptr;
+    const char *end = nullptr;
+    size_t mappedSize = 0;
+
+public:
+    explicit MappedCSVReader(const std::string &file);
+    ~MappedCSVReader();
+
+    MappedCSVReader(const MappedCSVReader &) = delete;
+    MappedCSVReader &operator=(const MappedCSVReader &) = delete;
+
+    std::vector<std::string> header() const;
+
+    // Cells that are missing or do not start with a number are skipped, like convertToFloat().
+    std::vector<float> readFloatColumn(size_t columnIndex) const;
+    std::vector<float> readFloatColumnByName(const std::string &columnName) const;
+
+    // Several columns in a single pass over the file; result i holds columnIndices[i].
+    std::vector<std::vector<float>> readFloatColumns(const std::vector<size_t> &columnIndices) const;
+    // Throws std::out_of_range for a name missing from the header.
+    std::vector<std::vector<float>> readFloatColumnsByName(const std::vector<std::string> &columnNames) const;
+
+    // Like readFloatColumns(), but with one value per data line so rows stay
+    // aligned across columns: a missing or non-numeric cell reads as NaN.
+    // Blank lines are skipped.
+    std::vector<std::vector<float>> readFloatRows(const std::vector<size_t> &columnIndices) const;
+    // Throws std::out_of_range for a name missing from the header.
+    std::vector<std::vector<float>> readFloatRowsByName(const std::vector<std::string> &columnNames) const;
+
+    // Header indices of the columns holding at least one number and nothing
+    // else but blank cells; a cell with text after its number, such as a
+    // date, makes its column non-numeric.
+    std::vector<size_t> numericColumns() const;
+};
+
 #endif 
@@ -0,0 +1,211 @@
+#pragma once
+#include "dataProcessing.hpp"
+#include "contextModel.hpp"
+#include <memory>
+
+// Self-describing compressed frame, all integers little endian:
+//
+//   magic "FPCR" | version u8 | flags u8 | value type u8 | predictor set u8 | table bits u8
+//   | element count varint | FPC byte count varint | frequency table | payload size varint | payload
+//   | CRC-32 of everything before it
+//
+// Older frames are still read: version 5 has no runs in its FPC bytes (see
+// fpcMinRun), version 4 also no value codec bits (always FPC + rANS),
+// version 3 also lacks the table bits byte (16-bit tables) and version 2
+// also the predictor set byte (FCM/DFCM).
+//
+// Bits 5-6 of the flags hold the frame's valueCodec. Only fpcEntropy frames
+// carry a frequency table and the entropy flags below. The others have an
+// empty model and their payload as is: the FPC bytes for fpcOnly; for raw and
+// xorBits, the values, little endian or XOR-packed (see xorCodec.hpp), with an
+// FPC byte count of zero.
+//
+// The frequency table is a 32-byte bitmap of the symbols in use followed by
+// (frequency - 1) varints for those symbols, in symbol order; the normalised
+// cumulative table is rebuilt by summing them. The payload is an interleaved
+// rANS stream, which carries its own interleave width.
+//
+// With frameFlagCompactTable the single table is normalised to 12 bits
+// instead of 16.
+//
+// With frameFlagContextModel the single table is replaced by a varint bitmask
+// of the contexts that occur and one 12-bit table per such context, in
+// context order, and the payload is coded by RANS::ContextRANS.
+//
+// With frameFlagSplitStreams the FPC stream is split by the same contexts
+// (RANS::splitContextStreams) and each context's bytes are coded as a stream
+// of their own with an order-0 12-bit table. The model is the context tables
+// followed by the symbol count and coded size (varints) of each such stream;
+// the payload holds the streams back to back in context order.
+
+namespace compression
+{
+    constexpr uint32_t frameMagic = 0x52435046;
+    constexpr uint8_t frameVersion = 6;
+
+    // The frame continues the predictor state of the previous frame in a stream.
+    constexpr uint8_t frameFlagContinued = 0x01;
+    // The payload is coded with per-context tables (see contextModel.hpp).
+    constexpr uint8_t frameFlagContextModel = 0x02;
+    // The values were rounded within an error bound before coding; decoding ignores it.
+    constexpr uint8_t frameFlagLossy = 0x04;
+    // The order-0 table uses RANS::compact_prob_bits.
+    constexpr uint8_t frameFlagCompactTable = 0x08;
+    // The payload holds one order-0 stream per context (see contextModel.hpp).
+    constexpr uint8_t frameFlagSplitStreams = 0x10;
+    // The valueCodec of the frame.
+    constexpr uint8_t frameCodecShift = 5;
+    constexpr uint8_t frameCodecMask = 0x60;
+
+    inline valueCodec frameValueCodec(uint8_t flags) { return (valueCodec)((flags & frameCodecMask) >> frameCodecShift); }
+    inline uint8_t valueCodecFrameFlags(valueCodec codec) { return (uint8_t)((uint8_t)codec << frameCodecShift); }
+
+    struct frameHeader
+    {
+        uint8_t flags = 0;
+        uint8_t valueType = 0;
+        uint8_t predictors = 0;
+        uint8_t tableBits = defaultTableBits;
+        uint64_t elementCount = 0;
+        uint64_t fpcSize = 0;
+    };
+
+    struct frameView
+    {
+        frameHeader header;
+        RANS::SymbolStats stats;
+        // Filled instead of `stats` for context-modelled and split-stream frames.
+        std::vector<RANS::SymbolStats> contextStats;
+        // Symbols and coded bytes of each split stream, zero for absent contexts.
+        uint64_t streamSymbols[RANS::maxContexts] = {};
+        uint64_t streamBytes[RANS::maxContexts] = {};
+        const uint8_t *payload = nullptr;
+        size_t payloadSize = 0;
+    };
+
+    void writeVarint(std::vector<uint8_t> &out, uint64_t value);
+    uint64_t readVarint(const uint8_t *&in, const uint8_t *end);
+
+    void writeU32(std::vector<uint8_t> &out, uint32_t value);
+    uint32_t readU32(const uint8_t *in);
+
+    uint32_t crc32(const uint8_t *data, size_t size, uint32_t crc = 0);
+
+    // Frame flags that select `backend` in encodeFrame().
+    inline uint8_t entropyFrameFlags(entropyBackend backend)
+    {
+        switch (backend)
+        {
+        case entropyBackend::contextModel:
+            return frameFlagContextModel;
+        case entropyBackend::order0Compact:
+            return frameFlagCompactTable;
+        case entropyBackend::splitStreams:
+            return frameFlagSplitStreams;
+        default:
+            return 0;
+        }
+    }
+
+    // Bytes per FPC word of a frame value type; throws std::runtime_error on an unknown type.
+    unsigned valueTypeWordBytes(uint8_t valueType);
+
+    // Predictor table bits of a frame; throws std::runtime_error when out of range.
+    unsigned frameTableBits(uint8_t tableBits);
+
+    void writeFrequencyTable(std::vector<uint8_t> &out, const RANS::SymbolStats &stats);
+    RANS::SymbolStats readFrequencyTable(const uint8_t *&in, const uint8_t *end, uint32_t scale = RANS::prob_scale);
+    void readFrequencyTable(const uint8_t *&in, const uint8_t *end, uint32_t scale, RANS::SymbolStats &stats);
+
+    void writeContextTables(std::vector<uint8_t> &out, const std::vector<RANS::SymbolStats> &contextStats);
+    std::vector<RANS::SymbolStats> readContextTables(const uint8_t *&in, const uint8_t *end);
+    void readContextTables(const uint8_t *&in, const uint8_t *end, std::vector<RANS::SymbolStats> &contextStats);
+
+    std::vector<uint8_t> buildFrame(const frameHeader &header, const RANS::SymbolStats &stats, const std::vector<uint8_t> &payload);
+    std::vector<uint8_t> buildFrame(const frameHeader &header, const std::vector<RANS::SymbolStats> &contextStats,
+                                    const std::vector<uint8_t> &payload);
+
+    // Validates magic, version, checksum and table; throws std::runtime_error on a bad frame.
+    // The returned view points into `frame`.
+    frameView parseFrame(const uint8_t *frame, size_t size);
+    // Same, reusing the tables of `view`.
+    void parseFrame(const uint8_t *frame, size_t size, frameView &view);
+
+    // Element count from the header alone, without the checksum or tables, so
+    // a caller can bound the output before decoding. Throws like parseFrame().
+    uint64_t frameElementCount(const uint8_t *frame, size_t size);
+
+    // rANS-codes an FPC byte stream and wraps it in a frame; frameFlagContextModel,
+    // frameFlagCompactTable or frameFlagSplitStreams in `flags` select the entropy coder.
+    std::vector<uint8_t> encodeFrame(const std::vector<uint8_t> &fpc, uint64_t elementCount, uint8_t valueType, uint8_t flags,
+                                     uint8_t predictors = 0, uint8_t tableBits = defaultTableBits);
+
+    // Largest frame encodeFrame() can produce for `fpcSize` FPC bytes.
+    size_t frameBound(size_t fpcSize);
+
+    // Largest frame FrameContext::encodePlain() can produce for `payloadSize` bytes.
+    size_t plainFrameBound(size_t payloadSize);
+
+    // Writes the frame to the start of output[0, capacity) and returns its size.
+    // Throws std::invalid_argument when capacity is below frameBound(fpcSize).
+    size_t encodeFrame(const uint8_t *fpc, size_t fpcSize, uint64_t elementCount, uint8_t valueType, uint8_t flags,
+                       uint8_t predictors, uint8_t tableBits, uint8_t *output, size_t capacity);
+
+    // Returns the FPC byte stream carried by a parsed frame. Order-0 decoders
+    // are cached by table (see FrameContext), so a run of blocks that
+    // normalised to the same table builds its lookup tables once.
+    std::vector<uint8_t> decodeFrameFpc(const frameView &view);
+
+    // Entropy coders, decoder cache and buffers carried from one frame to the
+    // next, so a long run of frames allocates nothing once the largest has
+    // been seen. The free encodeFrame() and decodeFrameFpc() use one per
+    // thread; compressorDecompressor owns its own. Not thread safe.
+    class FrameContext
+    {
+    public:
+        FrameContext();
+        ~FrameContext();
+
+        FrameContext(const FrameContext &) = delete;
+        FrameContext &operator=(const FrameContext &) = delete;
+
+        // As encodeFrame().
+        size_t encode(const uint8_t *fpc, size_t fpcSize, uint64_t elementCount, uint8_t valueType, uint8_t flags,
+                      uint8_t predictors, uint8_t tableBits, uint8_t *output, size_t capacity);
+
+        // Frame of a codec other than fpcEntropy around its payload, which is
+        // copied as is. Throws std::invalid_argument when capacity is below
+        // plainFrameBound(payloadSize).
+        size_t encodePlain(const frameHeader &header, const uint8_t *payload, size_t payloadSize, uint8_t *output, size_t capacity);
+
+        // As parseFrame(); the view is owned by the context and valid until the next parse().
+        const frameView &parse(const uint8_t *frame, size_t size);
+
+        // Writes the view.header.fpcSize FPC bytes of a parsed frame to `output`;
+        // throws std::runtime_error for a raw or xorBits frame, which has none.
+        void decodeFpc(const frameView &view, uint8_t *output);
+
+    private:
+        struct cachedDecoder
+        {
+            uint32_t scaleBits;
+            std::vector<uint32_t> table;
+            std::unique_ptr<RANS::RANS> decoder;
+        };
+
+        std::unique_ptr<RANS::RANS> encoder;
+        std::unique_ptr<RANS::ContextRANS> contextCoder;
+        // Codes the split streams one after the other.
+        std::unique_ptr<RANS::RANS> streamCoder;
+        std::vector<std::vector<uint8_t>> streams;
+        std::vector<RANS::SymbolStats> streamStats;
+        // Order-0 decoders of the last few tables, most recent first.
+        std::vector<cachedDecoder> decoders;
+        std::vector<uint8_t> head;
+        frameView view;
+
+        RANS::RANS &decoderFor(const RANS::SymbolStats &stats, uint32_t scaleBits);
+        size_t encodeSplit(const uint8_t *fpc, size_t fpcSize, const frameHeader &header, uint8_t *output, size_t capacity);
+        void decodeSplit(const frameView &view, uint8_t *output);
+    };
+}
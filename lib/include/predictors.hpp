@@ -0,0 +1,334 @@
+#pragma once
+#include "dataProcessing.hpp"
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+#include <utility>
+
+// Predictors of the FPC stage. Each one guesses the next word of a series
+// from the values it has been shown, through four members:
+//
+//   P(predictorArena &arena, unsigned tableBits)   takes any tables it needs from `arena`
+//   word predict() const                           guess for the next value
+//   void update(word value)                        shows it the actual value
+//   void reset()                                   forgets the series
+//
+// A predictorList bundles several into one compile-time set, so the coding
+// loops inline every call. The coder XORs each value with every prediction,
+// keeps the residual with the most leading zero bytes and stores the index of
+// the predictor that produced it (FCM wins ties). A run of repeats shows the
+// predictors only fpcMinRun of them, so a predictor must settle on a repeated
+// value within that many updates; the hashes of FCM and DFCM do for any table
+// size up to maxTableBits.
+namespace compression
+{
+    // Memory for the tables of one coder, recycled through a process-wide pool
+    // so short-lived coders neither allocate nor clear their tables. Tables
+    // are carved off in order and must hand the arena back cleared, which
+    // predictorTable::reset() makes cheap.
+    class predictorArena
+    {
+    public:
+        struct releaser
+        {
+            void operator()(predictorArena *arena) const;
+        };
+        using handle = std::unique_ptr<predictorArena, releaser>;
+
+        // A zeroed arena of at least `bytes` bytes, from the pool when one is free.
+        static handle acquire(size_t bytes);
+
+        // Next `bytes` bytes, 8-byte aligned; throws std::logic_error past the end.
+        void *carve(size_t bytes);
+
+    private:
+        std::unique_ptr<uint64_t[]> memory;
+        size_t words = 0;
+        size_t used = 0;
+
+        explicit predictorArena(size_t bytes);
+    };
+
+    // Hash table of predicted words whose reset costs what the series touched.
+    // The first 1/16th of the writes after a reset are logged; reset() clears
+    // just the logged slots, or the whole table once the log overflowed, which
+    // by then is a small share of the coding work. Reads stay a plain load.
+    template <typename W>
+    class predictorTable
+    {
+        static constexpr unsigned logShift = 4;
+
+        W *slots;
+        uint32_t *log;
+        uint32_t mask;
+        size_t logged = 0;
+
+    public:
+        static size_t bytes(unsigned bits)
+        {
+            return (sizeof(W) << bits) + (sizeof(uint32_t) << (bits - logShift));
+        }
+
+        predictorTable(predictorArena &arena, unsigned bits)
+            : slots(static_cast<W *>(arena.carve(sizeof(W) << bits))),
+              log(static_cast<uint32_t *>(arena.carve(sizeof(uint32_t) << (bits - logShift)))),
+              mask((1u << bits) - 1)
+        {
+        }
+
+        uint32_t indexMask() const { return mask; }
+
+        W get(uint32_t index) const { return slots[index]; }
+
+        void set(uint32_t index, W value)
+        {
+            if (logged < ((mask + 1) >> logShift))
+                log[logged] = index;
+            logged++;
+            slots[index] = value;
+        }
+
+        void reset()
+        {
+            if (logged <= ((mask + 1) >> logShift))
+            {
+                for (size_t i = 0; i < logged; i++)
+                    slots[log[i]] = 0;
+            }
+            else
+            {
+                std::fill_n(slots, mask + 1, 0);
+            }
+            logged = 0;
+        }
+    };
+
+    // Finite context method: the value that followed the last time the hash
+    // of the recent high bits was the same.
+    template <typename T>
+    class fcmPredictor
+    {
+        using word = typename fpcTraits<T>::word;
+        predictorTable<word> table;
+        uint32_t hash = 0;
+
+    public:
+        static constexpr unsigned tables = 1;
+
+        fcmPredictor(predictorArena &arena, unsigned tableBits) : table(arena, tableBits) {}
+
+        word predict() const { return table.get(hash); }
+
+        void update(word value)
+        {
+            table.set(hash, value);
+            hash = ((hash << 6) ^ (value >> fpcTraits<T>::fcmShift)) & table.indexMask();
+        }
+
+        void reset()
+        {
+            hash = 0;
+            table.reset();
+        }
+    };
+
+    // Differential FCM: like FCM, but over the deltas between consecutive words.
+    template <typename T>
+    class dfcmPredictor
+    {
+        using word = typename fpcTraits<T>::word;
+        predictorTable<word> table;
+        uint32_t hash = 0;
+        word last = 0;
+
+    public:
+        static constexpr unsigned tables = 1;
+
+        dfcmPredictor(predictorArena &arena, unsigned tableBits) : table(arena, tableBits) {}
+
+        word predict() const { return table.get(hash) + last; }
+
+        void update(word value)
+        {
+            word delta = value - last;
+            table.set(hash, delta);
+            hash = ((hash << 2) ^ (delta >> fpcTraits<T>::dfcmShift)) & table.indexMask();
+            last = value;
+        }
+
+        void reset()
+        {
+            hash = 0;
+            last = 0;
+            table.reset();
+        }
+    };
+
+    // Repeats the previous value; wins on flat stretches.
+    template <typename T>
+    class lastValuePredictor
+    {
+        using word = typename fpcTraits<T>::word;
+        word last = 0;
+
+    public:
+        static constexpr unsigned tables = 0;
+
+        lastValuePredictor(predictorArena &, unsigned) {}
+
+        word predict() const { return last; }
+        void update(word value) { last = value; }
+        void reset() { last = 0; }
+    };
+
+    // 2-delta stride over the words: the stride only changes once the same
+    // delta is seen twice in a row, so a lone outlier does not derail it.
+    template <typename T>
+    class stridePredictor
+    {
+        using word = typename fpcTraits<T>::word;
+        word last = 0;
+        word stride = 0;
+        word lastDelta = 0;
+
+    public:
+        static constexpr unsigned tables = 0;
+
+        stridePredictor(predictorArena &, unsigned) {}
+
+        word predict() const { return last + stride; }
+
+        void update(word value)
+        {
+            word delta = value - last;
+            if (delta == lastDelta)
+                stride = delta;
+            lastDelta = delta;
+            last = value;
+        }
+
+        void reset() { last = stride = lastDelta = 0; }
+    };
+
+    // Extrapolation in the value domain rather than on the bit patterns, which
+    // suits smooth signals. Only additions are used so the compiler cannot
+    // contract them into FMAs, which would round differently on some targets.
+    template <typename T>
+    class linearPredictor
+    {
+        using word = typename fpcTraits<T>::word;
+        T x1 = 0, x2 = 0;
+
+    public:
+        static constexpr unsigned tables = 0;
+
+        linearPredictor(predictorArena &, unsigned) {}
+
+        word predict() const
+        {
+            T d = x1 - x2;
+            T prediction = x1 + d;
+            word bits;
+            memcpy(&bits, &prediction, sizeof(word));
+            return bits;
+        }
+
+        void update(word value)
+        {
+            x2 = x1;
+            memcpy(&x1, &value, sizeof(word));
+        }
+
+        void reset() { x1 = x2 = 0; }
+    };
+
+    // 3 x1 - 3 x2 + x3: the parabola through the last three values.
+    template <typename T>
+    class quadraticPredictor
+    {
+        using word = typename fpcTraits<T>::word;
+        T x1 = 0, x2 = 0, x3 = 0;
+
+    public:
+        static constexpr unsigned tables = 0;
+
+        quadraticPredictor(predictorArena &, unsigned) {}
+
+        word predict() const
+        {
+            T d = x1 - x2;
+            T prediction = x3 + d + d + d;
+            word bits;
+            memcpy(&bits, &prediction, sizeof(word));
+            return bits;
+        }
+
+        void update(word value)
+        {
+            x3 = x2;
+            x2 = x1;
+            memcpy(&x1, &value, sizeof(word));
+        }
+
+        void reset() { x1 = x2 = x3 = 0; }
+    };
+
+    template <typename T, template <typename> class... Predictors>
+    class predictorList
+    {
+        using word = typename fpcTraits<T>::word;
+        std::tuple<Predictors<T>...> members;
+
+        template <size_t... I>
+        void predictAll(word *predictions, std::index_sequence<I...>) const
+        {
+            ((predictions[I] = std::get<I>(members).predict()), ...);
+        }
+
+        template <size_t... I>
+        word predictOne(unsigned index, std::index_sequence<I...>) const
+        {
+            word prediction = 0;
+            ((index == I ? (prediction = std::get<I>(members).predict(), 0) : 0), ...);
+            return prediction;
+        }
+
+    public:
+        predictorList(predictorArena &arena, unsigned tableBits) : members{Predictors<T>(arena, tableBits)...} {}
+
+        // Arena size the set needs for tables of 2^tableBits slots.
+        static size_t arenaBytes(unsigned tableBits)
+        {
+            return (Predictors<T>::tables + ...) * predictorTable<word>::bytes(tableBits);
+        }
+
+        static constexpr unsigned count = sizeof...(Predictors);
+        static constexpr unsigned selectorBits = count <= 2 ? 1 : count <= 4 ? 2 : 3;
+        static_assert(count >= 2 && count <= 8, "A predictor set holds 2 to 8 predictors");
+
+        void predictAll(word *predictions) const { predictAll(predictions, std::make_index_sequence<count>{}); }
+
+        // Prediction of the predictor at `index`; requires index < count.
+        word predict(unsigned index) const { return predictOne(index, std::make_index_sequence<count>{}); }
+
+        void update(word value)
+        {
+            std::apply([value](auto &...predictor) { (predictor.update(value), ...); }, members);
+        }
+
+        void reset()
+        {
+            std::apply([](auto &...predictor) { (predictor.reset(), ...); }, members);
+        }
+    };
+
+    template <typename T>
+    using fcmDfcmPredictors = predictorList<T, fcmPredictor, dfcmPredictor>;
+
+    template <typename T>
+    using stridePredictors = predictorList<T, fcmPredictor, dfcmPredictor, lastValuePredictor, stridePredictor>;
+
+    template <typename T>
+    using extrapolatingPredictors = predictorList<T, fcmPredictor, dfcmPredictor, lastValuePredictor, stridePredictor,
+                                                  linearPredictor, quadraticPredictor>;
+}
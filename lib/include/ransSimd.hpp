@@ -0,0 +1,35 @@
+#pragma once
+#include "dataProcessing.hpp"
+
+namespace RANS
+{
+    enum class decodeKernel
+    {
+        scalar,
+        sse41,
+        avx2
+    };
+
+    // Best kernel the running CPU supports, detected once at startup.
+    decodeKernel bestDecodeKernel();
+
+    decodeKernel activeDecodeKernel();
+
+    // Requests a kernel; anything the CPU cannot run falls back to the best one it can.
+    void setDecodeKernel(decodeKernel kernel);
+
+    const char *decodeKernelName(decodeKernel kernel);
+
+    // Per slot: frequency in the low 16 bits, slot - start in the high 16 bits.
+    vector<uint32_t> populateDecodingSlots(const SymbolStats &stats, uint32_t prob_scale);
+    void populateDecodingSlots(const SymbolStats &stats, uint32_t prob_scale, vector<uint32_t> &slots);
+
+    // Decodes whole groups of `ways` symbols with the active SIMD kernel while
+    // enough input is left for unguarded word loads. Returns the number of
+    // symbols written; the caller finishes the tail with the scalar decoder.
+    // Both tables span 2^scaleBits slots; `symbols` must be readable 3 bytes
+    // past the end for the byte gathers.
+    size_t decodeInterleavedSimd(state *states, uint32_t ways, const uint8_t *&input, const uint8_t *inputEnd,
+                                 const uint32_t *slots, const uint8_t *symbols, uint8_t *output, size_t symbolCount,
+                                 uint32_t scaleBits = prob_bits);
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include "blockCodec.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <thread>
+
+// On-disk store of named series. Each series is an append-only segment file
+// "<name>.<generation>.seg" of frames (see frameFormat.hpp), one per append,
+// read back through mmap. A manifest and the log after it are the only record
+// of what the segments hold, integers little endian. The manifest is replaced
+// atomically when a series is created or compacted and when the log outgrows
+// it:
+//
+//   magic "FPCM" | version u8 | value type u8 | series count varint
+//   | per series: name length varint, name bytes, generation varint, block count varint,
+//     per block: element count varint, frame size varint
+//   | CRC-32 of everything before it
+//
+// Other appends add one record to "MANIFEST.log", which a manifest rewrite
+// empties:
+//
+//   record size u32 | name length varint, name bytes, generation varint,
+//     block number varint, element count varint, frame size varint
+//   | CRC-32 of the record
+//
+// Records the manifest already covers are skipped on replay. Log records and
+// segment bytes past the last block either knows of are an append that did
+// not complete; they are cut off when the store is opened. Compaction rewrites a
+// series into the next generation, merging runs of small blocks into blocks
+// of up to the compaction target, which then share one frequency table and
+// one frame header.
+namespace compression
+{
+    constexpr uint32_t manifestMagic = 0x4d435046;
+    constexpr uint8_t manifestVersion = 1;
+    constexpr size_t defaultCompactionTarget = 1 << 16;
+
+    // Instantiated for the same value types as compressorDecompressor.
+    template <typename T = float>
+    class SeriesStore
+    {
+    public:
+        // Opens the store in `directory`, creating it when missing. Throws
+        // std::runtime_error on I/O errors, a bad manifest or a manifest written
+        // for another value type.
+        explicit SeriesStore(const std::string &directory);
+        ~SeriesStore();
+
+        SeriesStore(const SeriesStore &) = delete;
+        SeriesStore &operator=(const SeriesStore &) = delete;
+
+        // Apply to blocks written from then on, by append() and by compaction.
+        void setEntropyBackend(entropyBackend backend);
+        void setPredictorSet(predictorSet predictors);
+        // Throws std::invalid_argument outside [minTableBits, maxTableBits].
+        void setTableBits(unsigned tableBits);
+        void setCompactionTarget(size_t values);
+
+        // Compresses `values` into a new block at the end of `series`, creating
+        // the series on first use. Names are 1 to 64 characters from [A-Za-z0-9_.-]
+        // and must not start with '.'; others throw std::invalid_argument.
+        void append(const std::string &series, const std::vector<T> &values);
+
+        std::vector<std::string> seriesNames() const;
+
+        // Throw std::out_of_range for an unknown series.
+        uint64_t elementCount(const std::string &series) const;
+        size_t blockCount(const std::string &series) const;
+        std::vector<T> read(const std::string &series) const;
+        // Decodes only the blocks covering elements [begin, end).
+        std::vector<T> readRange(const std::string &series, uint64_t begin, uint64_t end) const;
+
+        // Merges small blocks of every series; returns how many blocks went away.
+        size_t compact();
+
+        // Runs compact() every `interval` on a background thread until
+        // stopCompaction(), which rethrows the first error that thread hit.
+        void startCompaction(std::chrono::milliseconds interval);
+        void stopCompaction();
+
+    private:
+        struct mappedSegment;
+
+        struct seriesState
+        {
+            uint64_t generation = 0;
+            // Offsets are relative to the start of the segment file.
+            blockIndex index;
+            // Mapping of the current segment; readers keep old ones alive across compaction.
+            mutable std::shared_ptr<mappedSegment> mapping;
+        };
+
+        std::string directory;
+        entropyBackend backend = entropyBackend::order0;
+        predictorSet predictors = predictorSet::fcmDfcm;
+        unsigned tableBits = defaultTableBits;
+        size_t compactionTarget = defaultCompactionTarget;
+
+        mutable std::mutex lock;
+        std::map<std::string, seriesState> series;
+        std::mutex compactionLock;
+        // Serializes appends and manifest writes through their I/O, which runs
+        // outside `lock`; taken before it. Guards the two sizes below.
+        std::mutex appendLock;
+        uint64_t manifestSize = 0;
+        uint64_t logSize = 0;
+
+        std::thread compactionThread;
+        std::mutex compactionWakeLock;
+        std::condition_variable compactionWake;
+        bool stopping = false;
+        std::exception_ptr compactionError;
+
+        std::string segmentPath(const std::string &name, uint64_t generation) const;
+        std::unique_ptr<compressorDecompressor<T>> makeCodec() const;
+        void writeManifest();
+        void appendLog(const std::string &name, uint64_t generation, size_t block, uint64_t elements, uint64_t frameSize);
+        void loadManifest();
+        void loadLog();
+        const seriesState &find(const std::string &name) const;
+        std::shared_ptr<mappedSegment> mapSegment(const std::string &name, const seriesState &state) const;
+        size_t compactSeries(const std::string &name);
+    };
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include "dataProcessing.hpp"
+#include <functional>
+
+// Streams are a sequence of chunks, each a frame size varint followed by the
+// frame. Every frame after the first carries frameFlagContinued: the FCM/DFCM
+// state runs on across chunks and only the rANS stage restarts, so memory
+// stays bounded by the chunk size however long the series is.
+namespace compression
+{
+    constexpr size_t defaultChunkValues = 1 << 14;
+
+    // Both stream classes are instantiated for the same value types as compressorDecompressor.
+    template <typename T>
+    class StreamCompressor
+    {
+    public:
+        using sink = std::function<void(const uint8_t *data, size_t size)>;
+
+        // Every chunk but the last holds `chunkValues` values.
+        explicit StreamCompressor(sink output, size_t chunkValues = defaultChunkValues);
+        ~StreamCompressor();
+
+        // Applies from the next chunk on; each chunk's frame records its backend.
+        void setEntropyBackend(entropyBackend backend) { this->backend = backend; }
+
+        // Predictor state runs across chunks, so the set and table size are fixed
+        // once the first chunk is out; changing them throws std::logic_error after that.
+        void setPredictorSet(predictorSet predictors);
+        void setTableBits(unsigned tableBits);
+
+        void push(const T *values, size_t count);
+
+        // Emits the partly filled chunk. The stream is complete afterwards.
+        void finish();
+
+    private:
+        sink output;
+        size_t chunkValues;
+        std::vector<T> pending;
+        std::vector<uint8_t> fpc;
+        // Size prefix and frame of the chunk being emitted, reused chunk to chunk.
+        std::vector<uint8_t> chunk;
+        std::unique_ptr<compressorDecompressor<T>> codec;
+        std::unique_ptr<FrameContext> frames;
+        entropyBackend backend = entropyBackend::order0;
+        bool started = false;
+        bool finished = false;
+
+        void emitChunk();
+    };
+
+    template <typename T>
+    class StreamDecompressor
+    {
+    public:
+        // Reads up to `size` bytes into `data`; returns 0 at the end of the stream.
+        using source = std::function<size_t(uint8_t *data, size_t size)>;
+
+        // Chunks of more than `maxChunkValues` values are rejected before
+        // anything is allocated for them, so it must be at least the
+        // compressor's chunkValues.
+        explicit StreamDecompressor(source input, size_t maxChunkValues = defaultChunkValues);
+
+        // Fills up to `count` values; returns how many were written, 0 once the stream is exhausted.
+        size_t pull(T *values, size_t count);
+
+    private:
+        source input;
+        size_t maxChunkValues;
+        std::vector<uint8_t> frame;
+        std::vector<T> decoded;
+        size_t position = 0;
+        std::unique_ptr<compressorDecompressor<T>> codec;
+        bool started = false;
+
+        bool readExact(uint8_t *data, size_t size);
+        bool nextChunk();
+    };
+}
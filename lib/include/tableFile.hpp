@@ -0,0 +1,163 @@
+#pragma once
+#include "dataProcessing.hpp"
+#include "fileReader.hpp"
+#include "threadPool.hpp"
+#include <fstream>
+
+// Columnar table file of equal-length named columns, integers little endian:
+//
+//   magic "FPCT" | version u8 | value type u8 | column chunks | footer | footer size u32 | magic "FPCT"
+//
+// Rows are cut into row groups and every column of a row group is one chunk,
+// an independent frame (see frameFormat.hpp), stored row group by row group
+// in column order. The footer holds column count varint, per column its name
+// length varint and name bytes, then row group count varint and per row group
+// its row count varint and per chunk: frame size varint, value count varint,
+// min and max as the value bits (4 or 8 bytes); then a CRC-32 of the footer.
+//
+// The value count leaves out NaNs, which stand for missing cells and are
+// left out of min and max too. A reader checks a predicate against the
+// footer statistics and decodes only the row groups it cannot rule out.
+namespace compression
+{
+    constexpr uint32_t tableMagic = 0x54435046;
+    constexpr uint8_t tableVersion = 1;
+    constexpr size_t defaultRowGroupRows = 1 << 16;
+
+    template <typename T>
+    struct columnChunk
+    {
+        // Byte range of the chunk's frame within the file.
+        uint64_t offset = 0;
+        uint64_t size = 0;
+        // Values other than NaN, and the smallest and largest of them; min and
+        // max are zero when there are none.
+        uint64_t count = 0;
+        T min = T();
+        T max = T();
+    };
+
+    template <typename T>
+    struct rowGroupEntry
+    {
+        uint64_t firstRow = 0;
+        uint64_t rowCount = 0;
+        std::vector<columnChunk<T>> chunks;
+    };
+
+    // Matches the rows whose value in `column` lies in [lower, upper]; NaN never matches.
+    template <typename T>
+    struct rangePredicate
+    {
+        std::string column;
+        T lower;
+        T upper;
+    };
+
+    // Instantiated for the same value types as compressorDecompressor.
+    template <typename T = float>
+    class TableWriter
+    {
+    public:
+        // Creates or truncates `path`. Throws std::invalid_argument for no
+        // columns, an empty or repeated name or zero rows per group, and
+        // std::runtime_error when the file cannot be written. Uses `pool` when
+        // given, otherwise starts one sized to the machine.
+        TableWriter(const std::string &path, const std::vector<std::string> &columnNames,
+                    size_t rowGroupRows = defaultRowGroupRows, ThreadPool *pool = nullptr);
+        // Finishes the file unless finish() was called; errors are lost, so
+        // call finish() to see them.
+        ~TableWriter();
+
+        TableWriter(const TableWriter &) = delete;
+        TableWriter &operator=(const TableWriter &) = delete;
+
+        // Apply to the row groups written from then on.
+        void setEntropyBackend(entropyBackend backend);
+        void setPredictorSet(predictorSet predictors);
+        // Throws std::invalid_argument outside [minTableBits, maxTableBits].
+        void setTableBits(unsigned tableBits);
+
+        const std::vector<std::string> &columnNames() const { return names; }
+        uint64_t rowCount() const { return rowsWritten + buffered[0].size(); }
+
+        // Appends rows given column by column, columns[i] holding the values of
+        // column i; throws std::invalid_argument unless there is one column per
+        // name and all have the same length. Full row groups are compressed and
+        // written as they fill.
+        void append(const std::vector<std::vector<T>> &columns);
+
+        // Writes the last partial row group and the footer, and closes the file.
+        void finish();
+
+    private:
+        std::string path;
+        std::ofstream file;
+        std::vector<std::string> names;
+        size_t rowGroupRows;
+        std::unique_ptr<ThreadPool> ownedPool;
+        ThreadPool *pool;
+        // One codec per column, kept warm across row groups.
+        std::vector<std::unique_ptr<compressorDecompressor<T>>> codecs;
+
+        std::vector<std::vector<T>> buffered;
+        std::vector<std::vector<uint8_t>> frames;
+        std::vector<rowGroupEntry<T>> rowGroups;
+        uint64_t rowsWritten = 0;
+        uint64_t fileSize = 0;
+        bool finished = false;
+
+        void writeRowGroup(size_t rows);
+        void writeBytes(const uint8_t *data, size_t size);
+    };
+
+    // Maps a table file and reads its footer up front; chunks are decoded on
+    // demand. Throws std::runtime_error for a file that cannot be read, is not
+    // a table, fails its footer checksum or holds another value type.
+    template <typename T = float>
+    class TableReader
+    {
+    public:
+        explicit TableReader(const std::string &path);
+        ~TableReader();
+
+        TableReader(const TableReader &) = delete;
+        TableReader &operator=(const TableReader &) = delete;
+
+        const std::vector<std::string> &columnNames() const { return names; }
+        const std::vector<rowGroupEntry<T>> &rowGroups() const { return groups; }
+        uint64_t rowCount() const { return groups.empty() ? 0 : groups.back().firstRow + groups.back().rowCount; }
+
+        // Index of the column called `name`; throws std::out_of_range when absent.
+        size_t columnIndex(const std::string &name) const;
+
+        std::vector<T> chunk(size_t rowGroup, size_t column) const;
+        std::vector<T> column(const std::string &name) const;
+
+        // Row groups whose statistics leave room for a row matching every
+        // predicate; the others need not be decoded.
+        std::vector<size_t> candidateRowGroups(const std::vector<rangePredicate<T>> &predicates) const;
+
+        // Rows matching every predicate, projected onto `columns` (result i
+        // holds columns[i]). Only candidate row groups are decoded, and their
+        // other columns only once a row of theirs matches.
+        std::vector<std::vector<T>> scan(const std::vector<std::string> &columns,
+                                         const std::vector<rangePredicate<T>> &predicates = {}) const;
+
+    private:
+        std::string path;
+        const uint8_t *data = nullptr;
+        size_t size = 0;
+        std::vector<std::string> names;
+        std::vector<rowGroupEntry<T>> groups;
+
+        void readFooter();
+        void decodeChunk(compressorDecompressor<T> &codec, size_t rowGroup, size_t column, std::vector<T> &values) const;
+    };
+
+    // Appends every data row of `csv` to `writer`, taking the columns named by
+    // the writer from the CSV header. Rows stay aligned across columns: missing
+    // and non-numeric cells become NaN. Throws std::out_of_range for a name
+    // missing from the header.
+    void appendCsv(TableWriter<float> &writer, const MappedCSVReader &csv);
+}
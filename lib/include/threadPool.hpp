@@ -0,0 +1,52 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace compression
+{
+    // Fixed set of workers, each with its own task deque. A worker pops from the
+    // front of its own deque and, when that is empty, steals from the back of
+    // the others, so uneven blocks still keep every core busy.
+    class ThreadPool
+    {
+    public:
+        explicit ThreadPool(size_t threads = std::thread::hardware_concurrency());
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        void submit(std::function<void()> task);
+
+        // Runs task(i) for every i in [0, count) and waits for all of them.
+        // The first exception thrown by a task is rethrown here. Called from
+        // one of this pool's own tasks, it runs the tasks inline instead.
+        void parallelFor(size_t count, const std::function<void(size_t)> &task);
+
+        size_t size() const { return workers.size(); }
+
+    private:
+        struct taskQueue
+        {
+            std::mutex lock;
+            std::deque<std::function<void()>> tasks;
+        };
+
+        std::vector<std::unique_ptr<taskQueue>> queues;
+        std::vector<std::thread> workers;
+        std::mutex wakeLock;
+        std::condition_variable wake;
+        std::atomic<size_t> pending{0};
+        std::atomic<size_t> nextQueue{0};
+        bool stopping = false;
+
+        bool popTask(size_t self, std::function<void()> &task);
+        void workerLoop(size_t self);
+    };
+}
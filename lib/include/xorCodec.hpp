@@ -0,0 +1,28 @@
+#pragma once
+#include "dataProcessing.hpp"
+
+// Gorilla-style XOR bit packing, the valueCodec::xorBits payload of a frame.
+// The first value is stored whole; every later one as the XOR with its
+// predecessor, least significant bit first:
+//
+//   0                                        XOR is zero
+//   1 0 | bits                               bits fit the window of the last "1 1" value
+//   1 1 | leading zeros | length - 1 | bits  new window: 5-bit leading zero count
+//                                            (at most 31), 5- or 6-bit length
+//
+// No tables and one pass, so it is far cheaper than FPC + rANS; it wins on
+// series whose neighbours share sign, exponent and high mantissa bits.
+namespace compression
+{
+    // Largest xorEncode() output for `count` values of T.
+    template <typename T>
+    size_t xorBound(size_t count);
+
+    // Writes at most xorBound(count) bytes to `output`; returns the bytes used.
+    template <typename T>
+    size_t xorEncode(const T *input, size_t count, uint8_t *output);
+
+    // Throws std::runtime_error when `input` ends before `count` values.
+    template <typename T>
+    void xorDecode(const uint8_t *input, size_t size, size_t count, T *output);
+}
@@ -0,0 +1,216 @@
+#include "blockCodec.hpp"
+#include "frameFormat.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+namespace compression
+{
+    template <typename T>
+    BlockCompressor<T>::BlockCompressor(size_t blockSize, ThreadPool *pool) : blockSize(blockSize), pool(pool)
+    {
+        if (blockSize == 0)
+            throw std::invalid_argument("Block size must be positive");
+        if (!this->pool)
+        {
+            ownedPool = std::make_unique<ThreadPool>();
+            this->pool = ownedPool.get();
+        }
+    }
+
+    size_t blockIndex::blockOf(uint64_t element) const
+    {
+        auto it = std::upper_bound(firstElement.begin(), firstElement.end(), element);
+        return (it - firstElement.begin()) - 1;
+    }
+
+    std::vector<uint8_t> buildContainer(const std::vector<std::vector<uint8_t>> &frames, const std::vector<uint64_t> &blockElements)
+    {
+        std::vector<uint8_t> container;
+        writeU32(container, containerMagic);
+        container.push_back(containerVersion);
+        for (const auto &frame : frames)
+            container.insert(container.end(), frame.begin(), frame.end());
+
+        size_t indexStart = container.size();
+        writeVarint(container, frames.size());
+        for (size_t block = 0; block < frames.size(); block++)
+        {
+            writeVarint(container, blockElements[block]);
+            writeVarint(container, frames[block].size());
+        }
+        writeU32(container, (uint32_t)(container.size() - indexStart));
+        writeU32(container, containerMagic);
+        return container;
+    }
+
+    blockIndex readBlockIndex(const uint8_t *container, size_t size)
+    {
+        const size_t headerSize = 5, trailerSize = 8;
+        if (size < headerSize + trailerSize || readU32(container) != containerMagic ||
+            readU32(container + size - 4) != containerMagic)
+            throw std::runtime_error("Not an FPC block container (bad magic)");
+        if (container[4] != containerVersion)
+            throw std::runtime_error("Unsupported block container version");
+
+        size_t indexSize = readU32(container + size - trailerSize);
+        if (indexSize > size - headerSize - trailerSize)
+            throw std::runtime_error("Block container index size is out of range");
+
+        const uint8_t *end = container + size - trailerSize;
+        const uint8_t *in = end - indexSize;
+        size_t blockCount = readVarint(in, end);
+        if (blockCount > indexSize)
+            throw std::runtime_error("Block container index is inconsistent");
+
+        blockIndex index;
+        index.firstElement.assign(1, 0);
+        index.offset.assign(1, headerSize);
+        for (size_t block = 0; block < blockCount; block++)
+        {
+            index.firstElement.push_back(index.firstElement.back() + readVarint(in, end));
+            index.offset.push_back(index.offset.back() + readVarint(in, end));
+        }
+        if (in != end || index.offset.back() != size - trailerSize - indexSize)
+            throw std::runtime_error("Block container index does not match its length");
+        return index;
+    }
+
+    template <typename T>
+    void BlockCompressor<T>::setTableBits(unsigned tableBits)
+    {
+        if (tableBits < minTableBits || tableBits > maxTableBits)
+            throw std::invalid_argument("Predictor table bits must be between " + std::to_string(minTableBits) +
+                                        " and " + std::to_string(maxTableBits));
+        this->tableBits = tableBits;
+    }
+
+    template <typename T>
+    void BlockCompressor<T>::setErrorBound(errorBoundMode mode, double bound)
+    {
+        if (!(bound >= 0))
+            throw std::invalid_argument("Error bound must be a non-negative number");
+        if (mode != errorBoundMode::lossless && !std::is_floating_point<T>::value)
+            throw std::invalid_argument("Error bounds apply to floating-point values only");
+        boundMode = mode;
+        this->bound = bound;
+    }
+
+    template <typename T>
+    std::unique_ptr<typename BlockCompressor<T>::worker> BlockCompressor<T>::takeWorker()
+    {
+        {
+            std::lock_guard<std::mutex> guard(workerLock);
+            if (!idleWorkers.empty())
+            {
+                std::unique_ptr<worker> idle = std::move(idleWorkers.back());
+                idleWorkers.pop_back();
+                return idle;
+            }
+        }
+        return std::make_unique<worker>();
+    }
+
+    // A task that throws drops its worker instead, so no codec is reused
+    // from the middle of a failed call.
+    template <typename T>
+    void BlockCompressor<T>::returnWorker(std::unique_ptr<worker> idle)
+    {
+        std::lock_guard<std::mutex> guard(workerLock);
+        idleWorkers.push_back(std::move(idle));
+    }
+
+    template <typename T>
+    std::vector<uint8_t> BlockCompressor<T>::compress(const std::vector<T> &input)
+    {
+        size_t blockCount = (input.size() + blockSize - 1) / blockSize;
+        frames.resize(blockCount);
+        std::vector<uint64_t> blockElements(blockCount);
+
+        pool->parallelFor(blockCount, [&](size_t block) {
+            size_t begin = block * blockSize;
+            size_t end = std::min(input.size(), begin + blockSize);
+
+            std::unique_ptr<worker> current = takeWorker();
+            compressorDecompressor<T> &coder = current->codec;
+            coder.setPredictorSet(predictors);
+            coder.setTableBits(tableBits);
+            coder.setEntropyBackend(backend);
+            coder.setValueCodec(codec);
+            coder.setErrorBound(boundMode, bound);
+
+            std::vector<uint8_t> &frame = frames[block];
+            frame.resize(coder.compressBound(end - begin));
+            frame.resize(coder.compress(input.data() + begin, end - begin, frame.data(), frame.size()));
+            blockElements[block] = end - begin;
+            returnWorker(std::move(current));
+        });
+
+        return buildContainer(frames, blockElements);
+    }
+
+    template <typename T>
+    std::vector<T> BlockCompressor<T>::decompress(const std::vector<uint8_t> &container)
+    {
+        blockIndex index = readBlockIndex(container.data(), container.size());
+        return decompressRange(container, 0, index.elementCount());
+    }
+
+    template <typename T>
+    std::vector<T> BlockCompressor<T>::decompressRange(const std::vector<uint8_t> &container, uint64_t begin, uint64_t end)
+    {
+        blockIndex index = readBlockIndex(container.data(), container.size());
+        if (begin > end || end > index.elementCount())
+            throw std::out_of_range("Element range is outside the container");
+
+        std::vector<T> output(end - begin);
+        if (begin == end)
+            return output;
+
+        size_t firstBlock = index.blockOf(begin);
+        size_t lastBlock = index.blockOf(end - 1);
+
+        pool->parallelFor(lastBlock - firstBlock + 1, [&](size_t i) {
+            size_t block = firstBlock + i;
+            const uint8_t *frame = container.data() + index.offset[block];
+            size_t frameSize = index.offset[block + 1] - index.offset[block];
+            uint64_t blockBegin = index.firstElement[block];
+            size_t blockElements = index.firstElement[block + 1] - blockBegin;
+            uint64_t from = std::max(begin, blockBegin);
+            uint64_t to = std::min(end, index.firstElement[block + 1]);
+
+            // Blocks wholly inside the range decode in place; only the ones cut
+            // by its ends go through the worker's scratch.
+            std::unique_ptr<worker> current = takeWorker();
+            bool whole = from == blockBegin && to - from == blockElements;
+            T *target = output.data() + (from - begin);
+            if (!whole)
+            {
+                current->partial.resize(blockElements);
+                target = current->partial.data();
+            }
+
+            size_t decoded;
+            try
+            {
+                decoded = current->codec.decompress(frame, frameSize, target, blockElements);
+            }
+            catch (const std::invalid_argument &)
+            {
+                decoded = blockElements + 1;
+            }
+            if (decoded != blockElements)
+                throw std::runtime_error("Block decoded to an unexpected length");
+
+            if (!whole)
+                std::copy(target + (from - blockBegin), target + (to - blockBegin), output.begin() + (from - begin));
+            returnWorker(std::move(current));
+        });
+        return output;
+    }
+
+    template class BlockCompressor<float>;
+    template class BlockCompressor<double>;
+    template class BlockCompressor<uint32_t>;
+    template class BlockCompressor<uint64_t>;
+}
@@ -0,0 +1,158 @@
+#include "columnArchive.hpp"
+#include "frameFormat.hpp"
+#include <algorithm>
+#include <set>
+#include <stdexcept>
+
+namespace compression
+{
+    std::vector<uint8_t> buildArchive(const std::vector<std::string> &names, const std::vector<std::vector<uint8_t>> &frames,
+                                      const std::vector<uint64_t> &elementCounts)
+    {
+        std::vector<uint8_t> archive;
+        writeU32(archive, archiveMagic);
+        archive.push_back(archiveVersion);
+        for (const auto &frame : frames)
+            archive.insert(archive.end(), frame.begin(), frame.end());
+
+        size_t directoryStart = archive.size();
+        writeVarint(archive, frames.size());
+        for (size_t column = 0; column < frames.size(); column++)
+        {
+            writeVarint(archive, names[column].size());
+            archive.insert(archive.end(), names[column].begin(), names[column].end());
+            writeVarint(archive, elementCounts[column]);
+            writeVarint(archive, frames[column].size());
+        }
+        writeU32(archive, (uint32_t)(archive.size() - directoryStart));
+        writeU32(archive, archiveMagic);
+        return archive;
+    }
+
+    std::vector<columnEntry> readColumnDirectory(const uint8_t *archive, size_t size)
+    {
+        const size_t headerSize = 5, trailerSize = 8;
+        if (size < headerSize + trailerSize || readU32(archive) != archiveMagic || readU32(archive + size - 4) != archiveMagic)
+            throw std::runtime_error("Not an FPC column archive (bad magic)");
+        if (archive[4] != archiveVersion)
+            throw std::runtime_error("Unsupported column archive version");
+
+        size_t directorySize = readU32(archive + size - trailerSize);
+        if (directorySize > size - headerSize - trailerSize)
+            throw std::runtime_error("Column archive directory size is out of range");
+
+        const uint8_t *end = archive + size - trailerSize;
+        const uint8_t *in = end - directorySize;
+        size_t columnCount = readVarint(in, end);
+        if (columnCount > directorySize)
+            throw std::runtime_error("Column archive directory is inconsistent");
+
+        std::vector<columnEntry> entries(columnCount);
+        uint64_t offset = headerSize;
+        for (auto &entry : entries)
+        {
+            uint64_t nameLength = readVarint(in, end);
+            if (nameLength > (uint64_t)(end - in))
+                throw std::runtime_error("Column archive directory is truncated");
+            entry.name.assign(reinterpret_cast<const char *>(in), nameLength);
+            in += nameLength;
+            entry.elementCount = readVarint(in, end);
+            entry.size = readVarint(in, end);
+            entry.offset = offset;
+            offset += entry.size;
+        }
+        if (in != end || offset != size - trailerSize - directorySize)
+            throw std::runtime_error("Column archive directory does not match its length");
+        return entries;
+    }
+
+    template <typename T>
+    ColumnCompressor<T>::ColumnCompressor(ThreadPool *pool) : pool(pool)
+    {
+        if (!this->pool)
+        {
+            ownedPool = std::make_unique<ThreadPool>();
+            this->pool = ownedPool.get();
+        }
+    }
+
+    template <typename T>
+    void ColumnCompressor<T>::setTableBits(unsigned tableBits)
+    {
+        if (tableBits < minTableBits || tableBits > maxTableBits)
+            throw std::invalid_argument("Predictor table bits must be between " + std::to_string(minTableBits) +
+                                        " and " + std::to_string(maxTableBits));
+        this->tableBits = tableBits;
+    }
+
+    template <typename T>
+    std::vector<uint8_t> ColumnCompressor<T>::compress(const std::vector<std::string> &names, const std::vector<std::vector<T>> &columns)
+    {
+        if (names.size() != columns.size())
+            throw std::invalid_argument("Column archive needs one name per column");
+        if (std::set<std::string>(names.begin(), names.end()).size() != names.size())
+            throw std::invalid_argument("Column archive names must be unique");
+
+        std::vector<std::vector<uint8_t>> frames(columns.size());
+        std::vector<uint64_t> elementCounts(columns.size());
+
+        pool->parallelFor(columns.size(), [&](size_t column) {
+            auto codec = std::make_unique<compressorDecompressor<T>>(predictors, tableBits);
+            codec->setEntropyBackend(backend);
+            frames[column] = codec->compress(columns[column]);
+            elementCounts[column] = columns[column].size();
+        });
+
+        return buildArchive(names, frames, elementCounts);
+    }
+
+    template <typename T>
+    ColumnArchive<T>::ColumnArchive(const uint8_t *archive, size_t size)
+        : archive(archive), entries(readColumnDirectory(archive, size))
+    {
+    }
+
+    template <typename T>
+    size_t ColumnArchive<T>::columnIndex(const std::string &name) const
+    {
+        auto it = std::find_if(entries.begin(), entries.end(), [&](const columnEntry &entry) { return entry.name == name; });
+        if (it == entries.end())
+            throw std::out_of_range("No column named " + name + " in the archive");
+        return it - entries.begin();
+    }
+
+    template <typename T>
+    std::vector<T> ColumnArchive<T>::column(size_t index) const
+    {
+        const columnEntry &entry = entries.at(index);
+        compressorDecompressor<T> codec;
+        std::vector<T> values = codec.decompress(archive + entry.offset, entry.size);
+        if (values.size() != entry.elementCount)
+            throw std::runtime_error("Column decoded to an unexpected length");
+        return values;
+    }
+
+    std::vector<uint8_t> compressCsv(ColumnCompressor<float> &compressor, const MappedCSVReader &csv,
+                                     const std::vector<std::string> &names)
+    {
+        if (!names.empty())
+            return compressor.compress(names, csv.readFloatRowsByName(names));
+
+        std::vector<std::string> header = csv.header();
+        std::vector<size_t> columnIndices = csv.numericColumns();
+        std::vector<std::string> selected;
+        for (size_t index : columnIndices)
+            selected.push_back(header[index]);
+        return compressor.compress(selected, csv.readFloatRows(columnIndices));
+    }
+
+    template class ColumnCompressor<float>;
+    template class ColumnCompressor<double>;
+    template class ColumnCompressor<uint32_t>;
+    template class ColumnCompressor<uint64_t>;
+
+    template class ColumnArchive<float>;
+    template class ColumnArchive<double>;
+    template class ColumnArchive<uint32_t>;
+    template class ColumnArchive<uint64_t>;
+}
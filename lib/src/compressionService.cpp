@@ -0,0 +1,673 @@
+#include "compressionService.hpp"
+#include "frameFormat.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace compression
+{
+    // epoll keys of the two descriptors that are not connections, whose ids count up from 1.
+    static constexpr uint64_t listenKey = ~0ull;
+    static constexpr uint64_t wakeKey = ~0ull - 1;
+
+    // Reads per connection and poll round, so one busy client cannot hold up the others.
+    static constexpr int readsPerRound = 16;
+
+    struct CompressionService::request
+    {
+        uint64_t connection = 0;
+        uint32_t id = 0;
+        serviceOp op = serviceOp::compress;
+        uint8_t valueType = 0;
+        uint8_t backend = 0;
+        uint8_t predictors = 0;
+        // An allocation of its own, so the values are aligned for their type.
+        std::vector<uint8_t> body;
+    };
+
+    struct CompressionService::response
+    {
+        uint64_t connection = 0;
+        std::vector<uint8_t> message;
+    };
+
+    struct CompressionService::connection
+    {
+        int fd = -1;
+        std::vector<uint8_t> input;
+        std::deque<std::vector<uint8_t>> output;
+        // Bytes of output.front() already sent.
+        size_t written = 0;
+        // Bytes of the messages in output, and the events polled for.
+        size_t queued = 0;
+        uint32_t watched = EPOLLIN;
+    };
+
+    // Warm coders of one worker task, one per value type.
+    struct CompressionService::workerContext
+    {
+        compressorDecompressor<float> floats;
+        compressorDecompressor<double> doubles;
+        compressorDecompressor<uint32_t> words;
+        compressorDecompressor<uint64_t> longWords;
+    };
+
+    [[noreturn]] static void throwSocketError(const std::string &what, const std::string &path)
+    {
+        throw std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+    }
+
+    static sockaddr_un socketAddress(const std::string &path)
+    {
+        sockaddr_un address{};
+        if (path.empty() || path.size() >= sizeof(address.sun_path))
+            throw std::invalid_argument("Socket path must be 1 to " + std::to_string(sizeof(address.sun_path) - 1) + " bytes");
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, path.c_str(), path.size());
+        return address;
+    }
+
+    static bool connectTo(int fd, const sockaddr_un &address)
+    {
+        return ::connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == 0;
+    }
+
+    static void watch(int epollFd, int operation, int fd, uint32_t events, uint64_t key)
+    {
+        epoll_event event{};
+        event.events = events;
+        event.data.u64 = key;
+        if (epoll_ctl(epollFd, operation, fd, &event) != 0)
+            throw std::runtime_error(std::string("epoll_ctl failed: ") + std::strerror(errno));
+    }
+
+    static void signalEvent(int fd)
+    {
+        uint64_t one = 1;
+        ssize_t ignored = ::write(fd, &one, sizeof(one));
+        (void)ignored;
+    }
+
+    // A response head with its length left to finishMessage().
+    static void startResponse(std::vector<uint8_t> &message, uint32_t id, serviceStatus status)
+    {
+        message.clear();
+        writeU32(message, 0);
+        writeU32(message, id);
+        message.push_back((uint8_t)status);
+    }
+
+    static void finishMessage(std::vector<uint8_t> &message)
+    {
+        uint32_t length = (uint32_t)(message.size() - 4);
+        for (int i = 0; i < 4; i++)
+            message[i] = (uint8_t)(length >> (i * 8));
+    }
+
+    // Appends the frame or the values answering one request to `message`;
+    // decompressed values beyond maxMessage are refused before decoding.
+    template <typename T>
+    static void answer(compressorDecompressor<T> &codec, serviceOp op, uint8_t backend, uint8_t predictors,
+                       const std::vector<uint8_t> &body, size_t maxMessage, std::vector<uint8_t> &message)
+    {
+        size_t head = message.size();
+        if (op == serviceOp::compress)
+        {
+            if (body.size() % sizeof(T))
+                throw std::invalid_argument("Compress request is not a whole number of values");
+            if (backend > (uint8_t)entropyBackend::splitStreams)
+                throw std::invalid_argument("Unknown entropy backend " + std::to_string(backend));
+            codec.setEntropyBackend((entropyBackend)backend);
+            codec.setPredictorSet(predictorSetFromCode(predictors));
+
+            size_t count = body.size() / sizeof(T);
+            message.resize(head + codec.compressBound(count));
+            message.resize(head + codec.compress(reinterpret_cast<const T *>(body.data()), count, message.data() + head,
+                                                 message.size() - head));
+        }
+        else if (op == serviceOp::decompress)
+        {
+            // The count is checked against the limit before any output exists,
+            // since a run frame of a few bytes can claim billions of values.
+            size_t room = maxMessage > head - 4 ? maxMessage - (head - 4) : 0;
+            uint64_t claimed = frameElementCount(body.data(), body.size());
+            if (claimed > room / sizeof(T))
+                throw std::runtime_error("Response exceeds the service message size limit");
+            size_t count = (size_t)claimed;
+
+            // Values are decoded at an aligned offset and slid down to the head.
+            message.resize(head + alignof(T) + count * sizeof(T));
+            uint8_t *values = message.data() + head;
+            size_t pad = (alignof(T) - (uintptr_t)values % alignof(T)) % alignof(T);
+            count = codec.decompress(body.data(), body.size(), reinterpret_cast<T *>(values + pad), count);
+            if (pad)
+                std::memmove(values, values + pad, count * sizeof(T));
+            message.resize(head + count * sizeof(T));
+        }
+        else
+        {
+            throw std::invalid_argument("Unknown service op " + std::to_string((int)op));
+        }
+    }
+
+    CompressionService::CompressionService(const std::string &socketPath, const serviceOptions &options)
+        : socketPath(socketPath), options(options), pool(options.workers)
+    {
+        this->options.maxBatch = std::max<size_t>(this->options.maxBatch, 1);
+        sockaddr_un address = socketAddress(socketPath);
+        try
+        {
+            listenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (listenFd < 0)
+                throwSocketError("Could not create a socket for", socketPath);
+
+            // A socket left by a service that is gone is replaced; a live one is not.
+            struct stat existing;
+            if (lstat(socketPath.c_str(), &existing) == 0 && S_ISSOCK(existing.st_mode))
+            {
+                int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+                bool live = probe >= 0 && connectTo(probe, address);
+                if (probe >= 0)
+                    ::close(probe);
+                if (live)
+                    throw std::runtime_error("A service is already listening on " + socketPath);
+                ::unlink(socketPath.c_str());
+            }
+
+            if (::bind(listenFd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0)
+                throwSocketError("Could not bind", socketPath);
+            if (::listen(listenFd, SOMAXCONN) != 0)
+                throwSocketError("Could not listen on", socketPath);
+
+            epollFd = epoll_create1(EPOLL_CLOEXEC);
+            wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (epollFd < 0 || wakeFd < 0)
+                throwSocketError("Could not set up polling for", socketPath);
+            watch(epollFd, EPOLL_CTL_ADD, listenFd, EPOLLIN, listenKey);
+            watch(epollFd, EPOLL_CTL_ADD, wakeFd, EPOLLIN, wakeKey);
+        }
+        catch (...)
+        {
+            closeDescriptors();
+            throw;
+        }
+    }
+
+    CompressionService::~CompressionService()
+    {
+        {
+            // Tasks touch this object until they have counted themselves out.
+            std::unique_lock<std::mutex> guard(completedLock);
+            allServed.wait(guard, [this] { return inFlight == 0; });
+        }
+        for (auto &entry : connections)
+            ::close(entry.second->fd);
+        closeDescriptors();
+        ::unlink(socketPath.c_str());
+    }
+
+    void CompressionService::closeDescriptors()
+    {
+        for (int fd : {listenFd, epollFd, wakeFd})
+        {
+            if (fd >= 0)
+                ::close(fd);
+        }
+        listenFd = epollFd = wakeFd = -1;
+    }
+
+    void CompressionService::stop()
+    {
+        stopping = true;
+        signalEvent(wakeFd);
+    }
+
+    void CompressionService::run()
+    {
+        epoll_event events[64];
+        while (!stopping)
+        {
+            int ready = epoll_wait(epollFd, events, 64, -1);
+            if (ready < 0 && errno == EINTR)
+                continue;
+            if (ready < 0)
+                throw std::runtime_error(std::string("epoll_wait failed: ") + std::strerror(errno));
+
+            for (int i = 0; i < ready; i++)
+            {
+                uint64_t key = events[i].data.u64;
+                if (key == listenKey)
+                {
+                    acceptClients();
+                    continue;
+                }
+                if (key == wakeKey)
+                {
+                    uint64_t count;
+                    ssize_t ignored = ::read(wakeFd, &count, sizeof(count));
+                    (void)ignored;
+                    continue;
+                }
+
+                auto found = connections.find(key);
+                if (found == connections.end())
+                    continue;
+                bool open = true;
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                    open = readRequests(key, *found->second);
+                if (open && (events[i].events & EPOLLOUT))
+                    open = writeResponses(key, *found->second);
+                if (!open)
+                    dropConnection(key);
+            }
+
+            // Everything this round read, from every client, goes out as one batch.
+            dispatch();
+            deliver();
+        }
+
+        {
+            std::unique_lock<std::mutex> guard(completedLock);
+            allServed.wait(guard, [this] { return inFlight == 0; });
+        }
+        deliver();
+    }
+
+    void CompressionService::acceptClients()
+    {
+        for (;;)
+        {
+            int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0 && errno == EINTR)
+                continue;
+            if (fd < 0)
+                return;
+
+            uint64_t id = nextConnection++;
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.u64 = id;
+            if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0)
+            {
+                ::close(fd);
+                continue;
+            }
+            auto client = std::make_unique<connection>();
+            client->fd = fd;
+            connections.emplace(id, std::move(client));
+        }
+    }
+
+    bool CompressionService::readRequests(uint64_t id, connection &client)
+    {
+        uint8_t chunk[1 << 16];
+        bool open = true;
+        for (int reads = 0; reads < readsPerRound; reads++)
+        {
+            ssize_t got = ::read(client.fd, chunk, sizeof(chunk));
+            if (got < 0 && errno == EINTR)
+                continue;
+            if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                break;
+            if (got <= 0)
+            {
+                open = false;
+                break;
+            }
+            client.input.insert(client.input.end(), chunk, chunk + got);
+        }
+
+        size_t position = 0;
+        while (open && client.input.size() - position >= 4)
+        {
+            const uint8_t *message = client.input.data() + position;
+            uint32_t length = readU32(message);
+            if (length < serviceRequestHead - 4 || length > options.maxMessage)
+                return false;
+            if (client.input.size() - position - 4 < length)
+                break;
+
+            request next;
+            next.connection = id;
+            next.id = readU32(message + 4);
+            next.op = (serviceOp)message[8];
+            next.valueType = message[9];
+            next.backend = message[10];
+            next.predictors = message[11];
+            next.body.assign(message + serviceRequestHead, message + 4 + length);
+            batch.push_back(std::move(next));
+            position += 4 + length;
+        }
+        client.input.erase(client.input.begin(), client.input.begin() + position);
+        return open;
+    }
+
+    bool CompressionService::writeResponses(uint64_t id, connection &client)
+    {
+        while (!client.output.empty())
+        {
+            const std::vector<uint8_t> &message = client.output.front();
+            ssize_t sent = ::send(client.fd, message.data() + client.written, message.size() - client.written, MSG_NOSIGNAL);
+            if (sent < 0 && errno == EINTR)
+                continue;
+            if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                break;
+            if (sent <= 0)
+                return false;
+
+            client.written += sent;
+            if (client.written == message.size())
+            {
+                client.queued -= message.size();
+                client.output.pop_front();
+                client.written = 0;
+            }
+        }
+
+        updateWatch(id, client);
+        return true;
+    }
+
+    void CompressionService::updateWatch(uint64_t id, connection &client)
+    {
+        uint32_t events = (client.queued <= options.maxMessage ? (uint32_t)EPOLLIN : 0u) |
+                          (client.output.empty() ? 0u : (uint32_t)EPOLLOUT);
+        if (events != client.watched)
+        {
+            watch(epollFd, EPOLL_CTL_MOD, client.fd, events, id);
+            client.watched = events;
+        }
+    }
+
+    void CompressionService::dropConnection(uint64_t id)
+    {
+        auto found = connections.find(id);
+        if (found == connections.end())
+            return;
+        ::close(found->second->fd);
+        connections.erase(found);
+    }
+
+    void CompressionService::dispatch()
+    {
+        if (batch.empty())
+            return;
+
+        // Spread the round over the workers, with no task over maxBatch requests.
+        size_t tasks = std::max((batch.size() + options.maxBatch - 1) / options.maxBatch, std::min(batch.size(), pool.size()));
+        size_t perTask = (batch.size() + tasks - 1) / tasks;
+        for (size_t start = 0; start < batch.size(); start += perTask)
+        {
+            auto end = batch.begin() + std::min(start + perTask, batch.size());
+            auto requests = std::make_shared<std::vector<request>>(std::make_move_iterator(batch.begin() + start),
+                                                                   std::make_move_iterator(end));
+            {
+                std::lock_guard<std::mutex> guard(completedLock);
+                inFlight++;
+            }
+            pool.submit([this, requests] { serve(*requests); });
+        }
+        batch.clear();
+    }
+
+    void CompressionService::serve(std::vector<request> &requests)
+    {
+        // Hands over the responses and counts the task out however it ends,
+        // so run() and the destructor never wait on a task that threw. Nothing
+        // of this object is touched once the count drops, so they may go
+        // ahead as soon as it does.
+        struct countOut
+        {
+            CompressionService &service;
+            std::vector<response> responses;
+
+            ~countOut()
+            {
+                std::lock_guard<std::mutex> guard(service.completedLock);
+                try
+                {
+                    std::move(responses.begin(), responses.end(), std::back_inserter(service.completed));
+                }
+                catch (...)
+                {
+                    // Out of memory: the clients miss these responses, the service goes on.
+                }
+                service.inFlight--;
+                signalEvent(service.wakeFd);
+                service.allServed.notify_all();
+            }
+        } task{*this, {}};
+
+        std::unique_ptr<workerContext> context;
+        {
+            std::lock_guard<std::mutex> guard(contextLock);
+            if (!idleContexts.empty())
+            {
+                context = std::move(idleContexts.back());
+                idleContexts.pop_back();
+            }
+        }
+
+        std::vector<response> &responses = task.responses;
+        responses.resize(requests.size());
+        for (size_t i = 0; i < requests.size(); i++)
+        {
+            const request &next = requests[i];
+            std::vector<uint8_t> &message = responses[i].message;
+            responses[i].connection = next.connection;
+            try
+            {
+                if (!context)
+                    context = std::make_unique<workerContext>();
+
+                startResponse(message, next.id, serviceStatus::ok);
+                switch (next.valueType)
+                {
+                case valueTypeCode<float>::value:
+                    answer(context->floats, next.op, next.backend, next.predictors, next.body, options.maxMessage, message);
+                    break;
+                case valueTypeCode<double>::value:
+                    answer(context->doubles, next.op, next.backend, next.predictors, next.body, options.maxMessage, message);
+                    break;
+                case valueTypeCode<uint32_t>::value:
+                    answer(context->words, next.op, next.backend, next.predictors, next.body, options.maxMessage, message);
+                    break;
+                case valueTypeCode<uint64_t>::value:
+                    answer(context->longWords, next.op, next.backend, next.predictors, next.body, options.maxMessage, message);
+                    break;
+                default:
+                    throw std::invalid_argument("Unknown value type " + std::to_string(next.valueType));
+                }
+                if (message.size() - 4 > options.maxMessage)
+                    throw std::runtime_error("Response exceeds the service message size limit");
+            }
+            catch (const std::exception &error)
+            {
+                startResponse(message, next.id, serviceStatus::error);
+                message.insert(message.end(), error.what(), error.what() + std::strlen(error.what()));
+            }
+            finishMessage(message);
+        }
+
+        if (context)
+        {
+            std::lock_guard<std::mutex> guard(contextLock);
+            idleContexts.push_back(std::move(context));
+        }
+    }
+
+    void CompressionService::deliver()
+    {
+        std::vector<response> done;
+        {
+            std::lock_guard<std::mutex> guard(completedLock);
+            done.swap(completed);
+        }
+
+        // Clients that had nothing queued get a write attempt; clients whose
+        // unread responses pass maxMessage stop being read until they drain.
+        std::vector<uint64_t> touched, overfull;
+        for (auto &finished : done)
+        {
+            auto found = connections.find(finished.connection);
+            if (found == connections.end())
+                continue;
+            connection &client = *found->second;
+            if (client.output.empty())
+                touched.push_back(finished.connection);
+            bool full = client.queued > options.maxMessage;
+            client.queued += finished.message.size();
+            if (!full && client.queued > options.maxMessage)
+                overfull.push_back(finished.connection);
+            client.output.push_back(std::move(finished.message));
+        }
+        for (uint64_t id : touched)
+        {
+            auto found = connections.find(id);
+            if (found != connections.end() && !writeResponses(id, *found->second))
+                dropConnection(id);
+        }
+        for (uint64_t id : overfull)
+        {
+            auto found = connections.find(id);
+            if (found != connections.end())
+                updateWatch(id, *found->second);
+        }
+    }
+
+    ServiceClient::ServiceClient(const std::string &socketPath)
+    {
+        sockaddr_un address = socketAddress(socketPath);
+        fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+            throwSocketError("Could not create a socket for", socketPath);
+        if (!connectTo(fd, address))
+        {
+            int error = errno;
+            ::close(fd);
+            errno = error;
+            throwSocketError("Could not connect to", socketPath);
+        }
+    }
+
+    ServiceClient::~ServiceClient()
+    {
+        ::close(fd);
+    }
+
+    static void sendAll(int fd, const uint8_t *data, size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t sent = ::send(fd, data, size, MSG_NOSIGNAL);
+            if (sent < 0 && errno == EINTR)
+                continue;
+            if (sent <= 0)
+                throw std::runtime_error(std::string("Could not send to the compression service: ") + std::strerror(errno));
+            data += sent;
+            size -= sent;
+        }
+    }
+
+    static void receiveAll(int fd, uint8_t *data, size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t got = ::recv(fd, data, size, 0);
+            if (got < 0 && errno == EINTR)
+                continue;
+            if (got == 0)
+                throw std::runtime_error("Compression service closed the connection");
+            if (got < 0)
+                throw std::runtime_error(std::string("Could not read from the compression service: ") + std::strerror(errno));
+            data += got;
+            size -= got;
+        }
+    }
+
+    uint32_t ServiceClient::send(serviceOp op, uint8_t valueType, entropyBackend backend, predictorSet predictors, const uint8_t *body,
+                                 size_t size)
+    {
+        if (size > UINT32_MAX - (serviceRequestHead - 4))
+            throw std::invalid_argument("Service request is too large");
+
+        uint32_t id = nextId++;
+        std::vector<uint8_t> head;
+        writeU32(head, (uint32_t)(serviceRequestHead - 4 + size));
+        writeU32(head, id);
+        head.push_back((uint8_t)op);
+        head.push_back(valueType);
+        head.push_back((uint8_t)backend);
+        head.push_back((uint8_t)predictors);
+        sendAll(fd, head.data(), head.size());
+        sendAll(fd, body, size);
+        return id;
+    }
+
+    serviceResponse ServiceClient::receive()
+    {
+        uint8_t head[serviceResponseHead];
+        receiveAll(fd, head, sizeof(head));
+        uint32_t length = readU32(head);
+        if (length < serviceResponseHead - 4)
+            throw std::runtime_error("Malformed compression service response");
+
+        serviceResponse response;
+        response.id = readU32(head + 4);
+        response.status = (serviceStatus)head[8];
+        response.body.resize(length - (serviceResponseHead - 4));
+        receiveAll(fd, response.body.data(), response.body.size());
+        return response;
+    }
+
+    serviceResponse ServiceClient::call(serviceOp op, uint8_t valueType, entropyBackend backend, predictorSet predictors,
+                                        const uint8_t *body, size_t size)
+    {
+        uint32_t id = send(op, valueType, backend, predictors, body, size);
+        serviceResponse response = receive();
+        if (response.id != id)
+            throw std::runtime_error("Compression service answered another request; do not mix send() with blocking calls");
+        if (response.status != serviceStatus::ok)
+            throw std::runtime_error("Compression service error: " + std::string(response.body.begin(), response.body.end()));
+        return response;
+    }
+
+    template <typename T>
+    std::vector<uint8_t> ServiceClient::compress(const std::vector<T> &values, entropyBackend backend, predictorSet predictors)
+    {
+        return call(serviceOp::compress, valueTypeCode<T>::value, backend, predictors, reinterpret_cast<const uint8_t *>(values.data()),
+                    values.size() * sizeof(T))
+            .body;
+    }
+
+    template <typename T>
+    std::vector<T> ServiceClient::decompress(const std::vector<uint8_t> &frame)
+    {
+        serviceResponse response =
+            call(serviceOp::decompress, valueTypeCode<T>::value, entropyBackend::order0, predictorSet::fcmDfcm, frame.data(), frame.size());
+        if (response.body.size() % sizeof(T))
+            throw std::runtime_error("Compression service returned a partial value");
+
+        std::vector<T> values(response.body.size() / sizeof(T));
+        std::memcpy(values.data(), response.body.data(), response.body.size());
+        return values;
+    }
+
+    template std::vector<uint8_t> ServiceClient::compress(const std::vector<float> &, entropyBackend, predictorSet);
+    template std::vector<uint8_t> ServiceClient::compress(const std::vector<double> &, entropyBackend, predictorSet);
+    template std::vector<uint8_t> ServiceClient::compress(const std::vector<uint32_t> &, entropyBackend, predictorSet);
+    template std::vector<uint8_t> ServiceClient::compress(const std::vector<uint64_t> &, entropyBackend, predictorSet);
+
+    template std::vector<float> ServiceClient::decompress(const std::vector<uint8_t> &);
+    template std::vector<double> ServiceClient::decompress(const std::vector<uint8_t> &);
+    template std::vector<uint32_t> ServiceClient::decompress(const std::vector<uint8_t> &);
+    template std::vector<uint64_t> ServiceClient::decompress(const std::vector<uint8_t> &);
+}
@@ -0,0 +1,268 @@
+#include "contextModel.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace RANS
+{
+    ContextRANS::ContextRANS(const uint8_t *input, size_t size, unsigned wordBytes, bool paired) : stats(maxContexts)
+    {
+        reset(input, size, wordBytes, paired);
+    }
+
+    ContextRANS::ContextRANS(vector<SymbolStats> normalised, unsigned wordBytes, bool paired)
+    {
+        if (normalised.size() != maxContexts)
+            throw std::invalid_argument("Context model needs one table per context");
+        stats = std::move(normalised);
+        this->wordBytes = wordBytes;
+        this->paired = paired;
+        initialiseSymbolTables();
+    }
+
+    void ContextRANS::reset(const uint8_t *input, size_t size, unsigned wordBytes, bool paired)
+    {
+        this->wordBytes = wordBytes;
+        this->paired = paired;
+        this->input = input;
+        inputSize = size;
+        contexts.resize(size);
+        stats.resize(maxContexts);
+        {
+            compression::stageTimer timer(compression::codecStage::histogram, inputSize);
+            for (auto &table : stats)
+                std::fill(table.frequencyArray.begin(), table.frequencyArray.end(), 0);
+            fpcContextTracker tracker(wordBytes, paired);
+            for (size_t i = 0; i < inputSize; i++)
+            {
+                uint32_t context = tracker.context();
+                contexts[i] = (uint8_t)context;
+                stats[context].frequencyArray[input[i]]++;
+                tracker.advance(input[i]);
+            }
+        }
+
+        {
+            compression::stageTimer timer(compression::codecStage::normalise, 0);
+            for (auto &table : stats)
+            {
+                if (std::any_of(table.frequencyArray.begin(), table.frequencyArray.end(), [](uint32_t f) { return f != 0; }))
+                    table.normaliseFrequency(context_prob_scale);
+                else
+                    std::fill(table.commulativeFrequency.begin(), table.commulativeFrequency.end(), 0);
+            }
+        }
+        initialiseSymbolTables();
+    }
+
+    void ContextRANS::reset(const vector<SymbolStats> &normalised, unsigned wordBytes, bool paired)
+    {
+        if (normalised.size() != maxContexts)
+            throw std::invalid_argument("Context model needs one table per context");
+        this->wordBytes = wordBytes;
+        this->paired = paired;
+        input = nullptr;
+        inputSize = 0;
+        stats = normalised;
+        initialiseSymbolTables();
+    }
+
+    void ContextRANS::initialiseSymbolTables()
+    {
+        compression::stageTimer timer(compression::codecStage::symbolTables, 0);
+        decodingSymbols.assign(maxContexts * 256, decoderSymbol{0, 0});
+        cummulativeFreq2Symbol.clear();
+
+        for (uint32_t context = 0; context < maxContexts; context++)
+        {
+            const SymbolStats &table = stats[context];
+            if (table.commulativeFrequency[256] == 0)
+                continue;
+
+            for (int s = 0; s < 256; s++)
+            {
+                decodingSymbolInitialise(&decodingSymbols[context * 256 + s], table.commulativeFrequency[s],
+                                         table.commulativeFrequency[s + 1] - table.commulativeFrequency[s]);
+            }
+        }
+    }
+
+    void ContextRANS::initialiseDecodingTables()
+    {
+        if (!cummulativeFreq2Symbol.empty())
+            return;
+        compression::stageTimer timer(compression::codecStage::symbolTables, 0);
+        cummulativeFreq2Symbol.assign(maxContexts * context_prob_scale, 0);
+        for (uint32_t context = 0; context < maxContexts; context++)
+        {
+            const SymbolStats &table = stats[context];
+            uint8_t *slots = cummulativeFreq2Symbol.data() + context * context_prob_scale;
+            for (int s = 0; s < 256 && table.commulativeFrequency[256] != 0; s++)
+                std::fill(slots + table.commulativeFrequency[s], slots + table.commulativeFrequency[s + 1], (uint8_t)s);
+        }
+    }
+
+    vector<uint8_t> ContextRANS::encodeInterleaved(uint32_t ways)
+    {
+        vector<uint8_t> buffer(interleavedBound(inputSize, ways));
+        size_t size = encodeInterleaved(buffer.data(), buffer.size(), ways);
+        return vector<uint8_t>(buffer.end() - size, buffer.end());
+    }
+
+    size_t ContextRANS::encodeInterleaved(uint8_t *output, size_t capacity, uint32_t ways)
+    {
+        if (ways != 2 && ways != 4 && ways != 8)
+            throw std::invalid_argument("rANS interleave width must be 2, 4 or 8");
+        if (capacity < interleavedBound(inputSize, ways))
+            throw std::invalid_argument("rANS output buffer is smaller than interleavedBound()");
+
+        compression::stageTimer timer(compression::codecStage::ransEncode, inputSize);
+        state states[maxInterleave];
+        for (uint32_t lane = 0; lane < ways; lane++)
+            states[lane] = wordLowerBound;
+
+        uint8_t *end = output + capacity;
+        uint8_t *out = end;
+
+        for (size_t i = inputSize; i-- > 0;)
+        {
+            wordEncoderWithSymbolTable(&states[i & (ways - 1)], out, &decodingSymbols[contexts[i] * 256 + input[i]],
+                                       context_prob_bits);
+        }
+
+        for (uint32_t lane = ways; lane-- > 0;)
+            encoderFlush(&states[lane], out);
+
+        *--out = (uint8_t)ways;
+        timer.bytesOut = end - out;
+        return end - out;
+    }
+
+    vector<uint8_t> ContextRANS::decodeInterleaved(const uint8_t *encoded, size_t encodedSize, size_t original_size)
+    {
+        vector<uint8_t> decoded(original_size);
+        decodeInterleaved(encoded, encodedSize, decoded.data(), original_size);
+        return decoded;
+    }
+
+    void ContextRANS::decodeInterleaved(const uint8_t *encoded, size_t encodedSize, uint8_t *output, size_t original_size)
+    {
+        if (encodedSize == 0)
+            throw std::runtime_error("rANS stream is empty");
+
+        uint32_t ways = encoded[0];
+        if ((ways != 2 && ways != 4 && ways != 8) || encodedSize < 1 + 4 * (size_t)ways)
+            throw std::runtime_error("rANS stream has an invalid interleave header");
+
+        compression::stageTimer timer(compression::codecStage::ransDecode, encodedSize);
+        timer.bytesOut = original_size;
+        const uint8_t *in = encoded + 1;
+        const uint8_t *end = encoded + encodedSize;
+        state states[maxInterleave];
+        for (uint32_t lane = 0; lane < ways; lane++)
+            initialiseWordDecoderState(&states[lane], in);
+
+        initialiseDecodingTables();
+        fpcContextTracker tracker(wordBytes, paired);
+        for (size_t i = 0; i < original_size; i++)
+        {
+            state *s = &states[i & (ways - 1)];
+            uint32_t context = tracker.context();
+            uint32_t symbol = cummulativeFreq2Symbol[context * context_prob_scale + (*s & (context_prob_scale - 1))];
+            const decoderSymbol *sym = &decodingSymbols[context * 256 + symbol];
+            if (sym->frequency == 0)
+                throw std::runtime_error("Context-modelled rANS stream uses a context without a table");
+
+            // The word decoder inlined with a bounds check: the context walk is
+            // driven by decoded bytes, so a bad stream must not run off the end.
+            uint32_t x = sym->frequency * (*s >> context_prob_bits) + (*s & (context_prob_scale - 1)) - sym->start;
+            if (x < wordLowerBound)
+            {
+                if (end - in < 2)
+                    throw std::runtime_error("Context-modelled rANS stream is truncated");
+                x = (x << 16) | (uint32_t)in[0] | ((uint32_t)in[1] << 8);
+                in += 2;
+            }
+            *s = x;
+
+            output[i] = (uint8_t)symbol;
+            tracker.advance((uint8_t)symbol);
+        }
+    }
+    // Calls visit(context, position) for every byte of an FPC stream of `size`
+    // bytes, in stream order; visit returns the byte, which for header bytes
+    // gives the residual lengths and marks runs. A residual is cut short where
+    // the stream ends, as after the empty second tag of an odd count.
+    template <typename Visit>
+    static void walkContexts(size_t size, unsigned wordBytes, bool paired, Visit visit)
+    {
+        const uint8_t *lengths = wordBytes == 8 ? compression::residualLength64 : compression::residualLength32;
+        uint8_t runTag = wordBytes == 8 ? compression::fpcTraits<uint64_t>::runCode : compression::fpcTraits<uint32_t>::runCode;
+        size_t position = 0;
+        while (position < size)
+        {
+            uint8_t header = visit(0, position);
+            position++;
+            uint8_t tags[2] = {(uint8_t)(paired ? header >> 4 : header), (uint8_t)(header & 0x0f)};
+            for (int t = 0; t < (paired ? 2 : 1); t++)
+            {
+                size_t length = std::min<size_t>(lengths[tags[t] & 0x07], size - position);
+                uint8_t last = 1;
+                for (size_t k = 0; k < length; k++)
+                    last = visit(1 + k, position + k);
+                position += length;
+                if (tags[t] == runTag && length == 1 && last == 0)
+                {
+                    while (position < size && (visit(1, position++) & 0x80))
+                    {
+                    }
+                }
+            }
+        }
+    }
+
+    void splitContextStreams(const uint8_t *fpc, size_t size, unsigned wordBytes, bool paired, vector<vector<uint8_t>> &streams)
+    {
+        size_t counts[maxContexts] = {};
+        walkContexts(size, wordBytes, paired, [&](uint32_t context, size_t position) {
+            counts[context]++;
+            return fpc[position];
+        });
+
+        // Run lengths aside, no context holds more bytes than there are values,
+        // so reserving that much keeps the storage stable once the largest
+        // batch has been seen.
+        size_t values = counts[0] * (paired ? 2 : 1);
+        streams.resize(maxContexts);
+        uint8_t *cursors[maxContexts];
+        for (uint32_t context = 0; context < maxContexts; context++)
+        {
+            streams[context].reserve(values);
+            streams[context].resize(counts[context]);
+            cursors[context] = streams[context].data();
+        }
+        walkContexts(size, wordBytes, paired, [&](uint32_t context, size_t position) {
+            *cursors[context]++ = fpc[position];
+            return fpc[position];
+        });
+    }
+
+    void mergeContextStreams(const vector<vector<uint8_t>> &streams, unsigned wordBytes, bool paired, uint8_t *output, size_t size)
+    {
+        if (streams.size() != maxContexts)
+            throw std::invalid_argument("Split streams need one stream per context");
+
+        size_t used[maxContexts] = {};
+        walkContexts(size, wordBytes, paired, [&](uint32_t context, size_t position) {
+            if (used[context] == streams[context].size())
+                throw std::runtime_error("Split stream is shorter than its FPC stream needs");
+            output[position] = streams[context][used[context]++];
+            return output[position];
+        });
+
+        for (uint32_t context = 0; context < maxContexts; context++)
+        {
+            if (used[context] != streams[context].size())
+                throw std::runtime_error("Split stream holds bytes its FPC stream does not use");
+        }
+    }
+}
@@ -1,17 +1,30 @@
 #include "dataProcessing.hpp"
+#include "ransSimd.hpp"
+#include "frameFormat.hpp"
+#include "predictors.hpp"
+#include "xorCodec.hpp"
 #include <algorithm>
 #include <cmath>
 #include <stdexcept>
 #include <iostream>
 #include <memory>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <type_traits>
 using namespace std;
 
 namespace RANS
 {
     void SymbolStats::calculateFrequency(const vector<uint8_t> &inputArray)
     {
-        for (uint8_t byte : inputArray)
-            frequencyArray[byte]++;
+        calculateFrequency(inputArray.data(), inputArray.size());
+    }
+
+    void SymbolStats::calculateFrequency(const uint8_t *input, size_t size)
+    {
+        for (size_t i = 0; i < size; i++)
+            frequencyArray[input[i]]++;
     }
 
     void SymbolStats::calculateCummulativeFrequency()
@@ -25,44 +38,84 @@ namespace RANS
     {
         assert(totalTarget >= 256);
 
-        calculateCummulativeFrequency();
-        uint32_t currentTotal = commulativeFrequency[256];
-
-        for (int i = 1; i <= 256; i++)
-            commulativeFrequency[i] = ((uint64_t)totalTarget * commulativeFrequency[i]) / currentTotal;
-
+        // A lone symbol would own the whole range, which does not fit the 16-bit
+        // frequency fields, so give a neighbour a single count to share it with.
+        int used = 0, lastUsed = 0;
         for (int i = 0; i < 256; i++)
         {
-            if (frequencyArray[i] && commulativeFrequency[i + 1] == commulativeFrequency[i])
+            if (frequencyArray[i])
             {
-                int best_steal = -1;
-                uint32_t best_freq = ~0u;
-
-                for (int j = 0; j < 256; j++)
-                {
-                    uint32_t freq = commulativeFrequency[j + 1] - commulativeFrequency[j];
-                    if (freq > 1 && freq < best_freq)
-                    {
-                        best_freq = freq;
-                        best_steal = j;
-                    }
-                }
+                used++;
+                lastUsed = i;
+            }
+        }
+        if (used < 2)
+        {
+            frequencyArray[lastUsed] = std::max(frequencyArray[lastUsed], 1u);
+            frequencyArray[(lastUsed + 1) & 0xff] = 1;
+        }
 
-                assert(best_steal != -1);
+        uint64_t currentTotal = 0;
+        for (int i = 0; i < 256; i++)
+            currentTotal += frequencyArray[i];
+
+        // Round every symbol that occurs to its nearest share, at least 1, using
+        // one 32.32 fixed-point reciprocal instead of a division per symbol.
+        uint64_t multiplier = ((uint64_t)totalTarget << 32) / currentTotal;
+        uint32_t scaled[256];
+        uint8_t symbols[256];
+        int symbolCount = 0;
+        int64_t left = totalTarget;
+        for (int i = 0; i < 256; i++)
+        {
+            scaled[i] = 0;
+            if (frequencyArray[i])
+            {
+                scaled[i] = std::max<uint32_t>(1, (uint32_t)((frequencyArray[i] * multiplier + (1ull << 31)) >> 32));
+                symbols[symbolCount++] = (uint8_t)i;
+                left -= scaled[i];
+            }
+        }
 
-                if (best_steal < i)
-                {
-                    for (int j = best_steal + 1; j <= i; j++)
-                        commulativeFrequency[j]--;
-                }
+        // Rounding leaves the total a few counts off. Settle the difference one
+        // count at a time where it matters least: a symbol seen f times at
+        // scaled frequency q gains or loses about f / q bits per count.
+        if (left > 0)
+        {
+            auto lessGain = [&](uint8_t a, uint8_t b) {
+                return (uint64_t)frequencyArray[a] * scaled[b] < (uint64_t)frequencyArray[b] * scaled[a];
+            };
+            std::make_heap(symbols, symbols + symbolCount, lessGain);
+            for (; left > 0; left--)
+            {
+                std::pop_heap(symbols, symbols + symbolCount, lessGain);
+                scaled[symbols[symbolCount - 1]]++;
+                std::push_heap(symbols, symbols + symbolCount, lessGain);
+            }
+        }
+        else if (left < 0)
+        {
+            auto moreCost = [&](uint8_t a, uint8_t b) {
+                return (uint64_t)frequencyArray[a] * scaled[b] > (uint64_t)frequencyArray[b] * scaled[a];
+            };
+            symbolCount = std::remove_if(symbols, symbols + symbolCount, [&](uint8_t symbol) { return scaled[symbol] == 1; }) - symbols;
+            std::make_heap(symbols, symbols + symbolCount, moreCost);
+            for (; left < 0; left++)
+            {
+                assert(symbolCount > 0);
+                std::pop_heap(symbols, symbols + symbolCount, moreCost);
+                uint8_t symbol = symbols[symbolCount - 1];
+                if (--scaled[symbol] > 1)
+                    std::push_heap(symbols, symbols + symbolCount, moreCost);
                 else
-                {
-                    assert(best_steal > i);
-                    for (int j = i + 1; j <= best_steal; j++)
-                        commulativeFrequency[j]++;
-                }
+                    symbolCount--;
             }
         }
+
+        commulativeFrequency[0] = 0;
+        for (int i = 0; i < 256; i++)
+            commulativeFrequency[i + 1] = commulativeFrequency[i] + scaled[i];
+        assert(commulativeFrequency[256] == totalTarget);
     }
 
     static void initialiseEncoderState(state *st)
@@ -70,22 +123,24 @@ namespace RANS
         *st = lowerBound;
     }
 
-    static void normaliseEncoder(state *s, vector<uint8_t>::iterator &outputBuffer, uint32_t upperBound)
+    static void normaliseEncoder(state *s, uint8_t *&outputBuffer, uint32_t upperBound)
     {
+        // The coding step needs x < upperBound; at x == upperBound it would
+        // overflow the 32-bit state.
         uint32_t x = *s;
-        if (x > upperBound)
+        if (x >= upperBound)
         {
             do
             {
                 --outputBuffer;
                 *outputBuffer = (uint8_t)(x & 0xff);
                 x >>= 8;
-            } while (x > upperBound);
+            } while (x >= upperBound);
         }
         *s = x;
     }
 
-    static void encoder(state *s, vector<uint8_t>::iterator &outputBuffer, uint32_t start, uint32_t frequency, uint32_t scaleBits)
+    static void encoder(state *s, uint8_t *&outputBuffer, uint32_t start, uint32_t frequency, uint32_t scaleBits)
     {
         const uint32_t precision = 32;
         uint32_t reciprocal = ((1ull << precision) + frequency - 1) / frequency;
@@ -94,15 +149,6 @@ namespace RANS
         *s = (quotient << scaleBits) + remainder + start;
     }
 
-    static void encoderFlush(state *s, vector<uint8_t>::iterator &outputBuffer)
-    {
-        uint32_t x = *s;
-        outputBuffer -= 4;
-
-        for (int i = 0; i < 4; i++)
-            outputBuffer[i] = (uint8_t)(x >> (i * 8));
-    }
-
     static void initialiseDecoderState(state *s, vector<uint8_t>::iterator &outputBuffer)
     {
         uint32_t x = 0;
@@ -143,7 +189,7 @@ namespace RANS
         *s = normaliseDecoder(&x, outputBuffer);
     }
 
-    static inline void getSymbolFromEncoder(state *s, vector<uint8_t>::iterator &outputBuffer, encoderSymbol const *sym)
+    static inline void getSymbolFromEncoder(state *s, uint8_t *&outputBuffer, encoderSymbol const *sym)
     {
         if (sym->upperBound == 0)
             return;
@@ -159,293 +205,952 @@ namespace RANS
         decoder(s, outputBuffer, sym->start, sym->frequency, scaleBits);
     }
 
+    size_t interleavedBound(size_t symbolCount, uint32_t ways)
+    {
+        return 1 + 4 * (size_t)ways + 2 * symbolCount;
+    }
+
+    size_t streamBound(size_t symbolCount)
+    {
+        return 4 + 2 * symbolCount;
+    }
+
     vector<uint8_t> populateCummulativeFreq2Symbol(const SymbolStats &stats, uint32_t prob_scale)
     {
-        vector<uint8_t> cummulativeFreq2Symbol(prob_scale);
+        vector<uint8_t> cummulativeFreq2Symbol;
+        populateCummulativeFreq2Symbol(stats, prob_scale, cummulativeFreq2Symbol);
+        return cummulativeFreq2Symbol;
+    }
+
+    void populateCummulativeFreq2Symbol(const SymbolStats &stats, uint32_t prob_scale, vector<uint8_t> &symbols)
+    {
+        symbols.resize(prob_scale);
         for (int s = 0; s < 256; s++)
         {
             uint32_t start = stats.commulativeFrequency[s];
             uint32_t end = stats.commulativeFrequency[s + 1];
-            std::fill(cummulativeFreq2Symbol.begin() + start, cummulativeFreq2Symbol.begin() + end, s);
+            std::fill(symbols.begin() + start, symbols.begin() + end, s);
         }
-        return cummulativeFreq2Symbol;
+    }
+
+    void RANS::reset(const uint8_t *input, size_t size, uint32_t scaleBits)
+    {
+        this->scaleBits = checkedScaleBits(scaleBits);
+        this->input = input;
+        inputSize = size;
+        {
+            compression::stageTimer timer(compression::codecStage::histogram, inputSize);
+            std::fill(stats.frequencyArray.begin(), stats.frequencyArray.end(), 0);
+            stats.calculateFrequency(input, inputSize);
+        }
+        {
+            compression::stageTimer timer(compression::codecStage::normalise, 0);
+            stats.normaliseFrequency(1u << scaleBits);
+        }
+        initialiseSymbolTables();
+        cummulativeFreq2Symbol.clear();
+        decodingSlots.clear();
+    }
+
+    void RANS::reset(const SymbolStats &normalised, uint32_t scaleBits)
+    {
+        this->scaleBits = checkedScaleBits(scaleBits);
+        input = nullptr;
+        inputSize = 0;
+        stats = normalised;
+        initialiseSymbolTables();
+        cummulativeFreq2Symbol.clear();
+        decodingSlots.clear();
     }
 
     vector<uint8_t> RANS::encode()
     {
+        compression::stageTimer timer(compression::codecStage::ransEncode, inputSize);
         initialiseEncoderState(&rans);
 
-        ptr = outputBuffer.end();
+        if (outputBuffer.size() < streamBound(inputSize))
+            outputBuffer.resize(streamBound(inputSize));
+        uint8_t *end = outputBuffer.data() + outputBuffer.size();
+        uint8_t *ptr = end;
 
-        for (auto i = inputArray.rbegin(); i != inputArray.rend(); ++i)
+        for (size_t i = inputSize; i-- > 0;)
         {
-            getSymbolFromEncoder(&rans, ptr, &encodingSymbols[*i]);
+            getSymbolFromEncoder(&rans, ptr, &encodingSymbols[input[i]]);
         }
 
         encoderFlush(&rans, ptr);
-        rans_begin = ptr;
 
-        return vector<uint8_t>(rans_begin, outputBuffer.end());
+        timer.bytesOut = end - ptr;
+        return vector<uint8_t>(ptr, end);
     }
 
     vector<uint8_t> RANS::decode(vector<uint8_t> &encoded, size_t original_size)
     {
+        compression::stageTimer timer(compression::codecStage::ransDecode, encoded.size());
+        timer.bytesOut = original_size;
 
+        initialiseDecodingTables();
+        decodingBytes.resize(original_size);
         auto ptr = encoded.begin();
         initialiseDecoderState(&rans, ptr);
 
         for (size_t i = 0; i < original_size; i++)
         {
-            uint32_t s = cummulativeFreq2Symbol[getCFforDecodingSymbol(&rans, prob_bits)];
+            uint32_t s = cummulativeFreq2Symbol[getCFforDecodingSymbol(&rans, scaleBits)];
             decodingBytes[i] = (uint8_t)s;
-            decoderWithSymbolTable(&rans, ptr, &decodingSymbols[s], prob_bits);
+            decoderWithSymbolTable(&rans, ptr, &decodingSymbols[s], scaleBits);
             
         }
         return decodingBytes;
     }
 
-}
+    vector<uint8_t> RANS::encodeInterleaved(uint32_t ways)
+    {
+        vector<uint8_t> buffer(interleavedBound(inputSize, ways));
+        size_t size = encodeInterleaved(buffer.data(), buffer.size(), ways);
+        return vector<uint8_t>(buffer.end() - size, buffer.end());
+    }
 
-namespace compression
-{
-    void compressorDecompressor::updateFcmHash(uint64_t true_value)
+    size_t RANS::encodeInterleaved(uint8_t *output, size_t capacity, uint32_t ways)
     {
-        fcm[fcm_hash] = true_value;
-        fcm_hash = ((fcm_hash << 6) ^ (true_value >> 48)) & (TABLE_SIZE - 1);
+        if (ways != 2 && ways != 4 && ways != 8)
+            throw std::invalid_argument("rANS interleave width must be 2, 4 or 8");
+        if (capacity < interleavedBound(inputSize, ways))
+            throw std::invalid_argument("rANS output buffer is smaller than interleavedBound()");
+
+        compression::stageTimer timer(compression::codecStage::ransEncode, inputSize);
+        state states[maxInterleave];
+        for (uint32_t lane = 0; lane < ways; lane++)
+            states[lane] = wordLowerBound;
+
+        uint8_t *end = output + capacity;
+        uint8_t *out = end;
+
+        // Encode backwards so the decoder reads the stream front to back.
+        for (size_t i = inputSize; i-- > 0;)
+            wordEncoderWithSymbolTable(&states[i & (ways - 1)], out, &decodingSymbols[input[i]], scaleBits);
+
+        for (uint32_t lane = ways; lane-- > 0;)
+            encoderFlush(&states[lane], out);
+
+        *--out = (uint8_t)ways;
+        timer.bytesOut = end - out;
+        return end - out;
     }
-    void compressorDecompressor::updateDfcmHash(uint64_t true_value)
+
+    vector<uint8_t> RANS::decodeInterleaved(const vector<uint8_t> &encoded, size_t original_size)
     {
-        dfcm[dfcm_hash] = (true_value - last_value);
-        dfcm_hash = ((dfcm_hash << 2) ^ ((true_value - last_value) >> 40)) & (TABLE_SIZE - 1);
-        last_value = true_value;
+        return decodeInterleaved(encoded.data(), encoded.size(), original_size);
     }
 
-    void compressorDecompressor::reset()
+    vector<uint8_t> RANS::decodeInterleaved(const uint8_t *encoded, size_t encodedSize, size_t original_size)
     {
-        fcm_hash = 0;
-        dfcm_hash = 0;
-        last_value = 0;
-        std::fill_n(fcm, TABLE_SIZE, 0);
-        std::fill_n(dfcm, TABLE_SIZE, 0);
+        vector<uint8_t> decoded(original_size);
+        decodeInterleaved(encoded, encodedSize, decoded.data(), original_size);
+        return decoded;
     }
-    uint64_t compressorDecompressor::getFcmPrediction()
+
+    void RANS::decodeInterleaved(const uint8_t *encoded, size_t encodedSize, uint8_t *output, size_t original_size)
+    {
+        if (encodedSize == 0)
+            throw std::runtime_error("rANS stream is empty");
+
+        uint32_t ways = encoded[0];
+        if ((ways != 2 && ways != 4 && ways != 8) || encodedSize < 1 + 4 * (size_t)ways)
+            throw std::runtime_error("rANS stream has an invalid interleave header");
+
+        compression::stageTimer timer(compression::codecStage::ransDecode, encodedSize);
+        timer.bytesOut = original_size;
+        const uint8_t *in = encoded + 1;
+        state states[maxInterleave];
+        for (uint32_t lane = 0; lane < ways; lane++)
+            initialiseWordDecoderState(&states[lane], in);
+
+        initialiseDecodingTables();
+        size_t i = 0;
+        // The SIMD kernels need a 32-bit slot table; below one symbol per slot
+        // building it costs more than the kernels save.
+        if (activeDecodeKernel() != decodeKernel::scalar && ways >= 4 && original_size >= (1u << scaleBits))
+        {
+            if (decodingSlots.empty())
+                populateDecodingSlots(stats, 1u << scaleBits, decodingSlots);
+
+            i = decodeInterleavedSimd(states, ways, in, encoded + encodedSize, decodingSlots.data(),
+                                      cummulativeFreq2Symbol.data(), output, original_size, scaleBits);
+        }
+
+        // Byte stores alias everything, so keep the tables and scale in locals
+        // rather than have them reloaded through `this` for every symbol.
+        const uint32_t bits = scaleBits;
+        const uint8_t *slotSymbols = cummulativeFreq2Symbol.data();
+        const decoderSymbol *symbols = decodingSymbols.data();
+        const uint8_t *end = encoded + encodedSize;
+        for (; i < original_size; i++)
+        {
+            state *s = &states[i & (ways - 1)];
+            uint32_t symbol = slotSymbols[getCFforDecodingSymbol(s, bits)];
+            output[i] = (uint8_t)symbol;
+            wordDecoderWithSymbolTable(s, in, end, &symbols[symbol], bits);
+        }
+    }
+
+}
+
+namespace compression
+{
+    predictorSet predictorSetFromCode(uint8_t code)
     {
-        return fcm[fcm_hash];
+        if (code > (uint8_t)predictorSet::extrapolating)
+            throw std::runtime_error("Unknown predictor set " + std::to_string(code));
+        return (predictorSet)code;
     }
-    uint64_t compressorDecompressor::getDfcmPrediction()
+
+    static inline int leadingZeros(uint64_t value)
+    {
+        return value ? __builtin_clzll(value) : 64;
+    }
+
+    static inline int leadingZeros(uint32_t value)
     {
-        return dfcm[dfcm_hash] + last_value;
+        return value ? __builtin_clz(value) : 32;
     }
 
-    uint8_t compressorDecompressor::encodeZeroBytes(uint64_t diff)
+    template <typename W>
+    static inline uint8_t encodeZeroBytes(W diff)
     {
         if (diff == 0)
-            return 7;
-        uint8_t leadingZeroBytes = __builtin_clzll(diff) / 8;
-        if (leadingZeroBytes >= 4)
+            return fpcTraits<W>::zeroResidualCode;
+        uint8_t leadingZeroBytes = leadingZeros(diff) / 8;
+        if (fpcTraits<W>::wordBytes == 8 && leadingZeroBytes >= 4)
             leadingZeroBytes--;
         return leadingZeroBytes;
     }
 
-    std::vector<uint8_t> toByteArray(uint64_t diff)
-    {
-        uint8_t leadingZeroBytes = __builtin_clzll(diff) / 8;
-        if (leadingZeroBytes >= 4)
-            leadingZeroBytes--;
-        if (diff == 0)
-            leadingZeroBytes = 7;
+    // Load masks by residual length.
+    static const uint64_t residualMask[9] = {0, 0xff, 0xffff, 0xffffff, 0xffffffff, 0xffffffffffull,
+                                             0xffffffffffffull, 0xffffffffffffffull, ~0ull};
 
-        int encodedZeroBytes = leadingZeroBytes;
+    // Stores the whole word unaligned; the excess is overwritten by the next
+    // write, which is why fpcBound() keeps a word of slack.
+    template <typename W>
+    static inline uint8_t *putResidual(uint8_t *out, W residual, uint8_t code)
+    {
+        memcpy(out, &residual, sizeof(W));
+        return out + fpcTraits<W>::residualLength[code];
+    }
 
-        if (encodedZeroBytes > 3)
-            encodedZeroBytes++;
+    static inline uint8_t *putVarint(uint8_t *out, uint64_t value)
+    {
+        for (; value >= 0x80; value >>= 7)
+            *out++ = (uint8_t)(value | 0x80);
+        *out++ = (uint8_t)value;
+        return out;
+    }
 
-        std::vector<uint8_t> array(8 - encodedZeroBytes);
+    template <typename W>
+    static inline W getResidual(const uint8_t *&in, const uint8_t *end, uint8_t code)
+    {
+        size_t length = fpcTraits<W>::residualLength[code];
+        if ((size_t)(end - in) < length)
+            throw std::runtime_error("FPC stream is truncated");
 
-        for (size_t i = 0; i < array.size(); i++)
+        W residual = 0;
+        if ((size_t)(end - in) >= sizeof(W))
         {
-            array[i] = static_cast<uint8_t>(diff & 0xff);
-            diff >>= 8;
+            memcpy(&residual, in, sizeof(W));
+            residual &= (W)residualMask[length];
         }
-
-        return array;
+        else
+        {
+            for (size_t k = 0; k < length; k++)
+                residual |= (W)in[k] << (k * 8);
+        }
+        in += length;
+        return residual;
     }
 
-    uint64_t compressorDecompressor::toLong(const std::vector<uint8_t> &dst)
+    // The FPC stage behind compressorDecompressor, one implementation per
+    // predictor set so the choice is made once per call, not once per value.
+    template <typename T>
+    class fpcCoder
     {
-        uint64_t result = 0;
-        for (size_t i = 0; i < dst.size(); ++i)
+    public:
+        virtual ~fpcCoder() = default;
+        virtual predictorSet set() const = 0;
+        virtual unsigned tableBits() const = 0;
+        virtual size_t encode(const T *input, size_t count, uint8_t *output) = 0;
+        virtual void decode(const uint8_t *fpcCpmpreesed, size_t fpcSize, size_t originalSize, T *output) = 0;
+        virtual void reset() = 0;
+    };
+
+    template <typename T, typename Predictors, predictorSet Set>
+    class fpcPredictorCoder final : public fpcCoder<T>
+    {
+        using word = typename fpcTraits<T>::word;
+        unsigned bits;
+        predictorArena::handle arena;
+        Predictors predictors;
+        // Values per tag since the last flushTagCounts(); instrumented builds only.
+        uint64_t tagCounts[64] = {};
+
+        void flushTagCounts()
         {
-            result |= static_cast<uint64_t>(dst[i]) << (i * 8);
+            if constexpr (instrumentationEnabled)
+            {
+                if (codecStats *stats = activeStats())
+                {
+                    for (unsigned tag = 0; tag < 64; tag++)
+                    {
+                        stats->predictorHits[tag >> 3] += tagCounts[tag];
+                        stats->zeroByteCodes[tag & 0x07] += tagCounts[tag];
+                    }
+                }
+                std::fill_n(tagCounts, 64, 0);
+            }
         }
-        return result;
-    }
 
-    std::pair<std::vector<uint8_t>, size_t> compressorDecompressor::compress(const std::vector<float> &input)
-    {
+        // Tag of one value: predictor index above the 3-bit zero-byte code.
+        inline uint8_t encodeValue(word value, word &residual)
+        {
+            word predictions[Predictors::count];
+            predictors.predictAll(predictions);
 
-        std::vector<uint8_t> compressed;
+            unsigned best = 0;
+            residual = value ^ predictions[0];
+            int bestZeros = leadingZeros(residual);
+            for (unsigned k = 1; k < Predictors::count; k++)
+            {
+                word candidate = value ^ predictions[k];
+                int zeros = leadingZeros(candidate);
+                if (zeros > bestZeros)
+                {
+                    best = k;
+                    residual = candidate;
+                    bestZeros = zeros;
+                }
+            }
+            predictors.update(value);
+            uint8_t tag = (uint8_t)((best << 3) | encodeZeroBytes(residual));
+            if constexpr (instrumentationEnabled)
+                tagCounts[tag]++;
+            return tag;
+        }
 
-        for (size_t i = 0; i < input.size(); i += 2)
+        inline word decodeValue(uint8_t tag, const uint8_t *&in, const uint8_t *end)
         {
-            uint64_t first_true_value = *reinterpret_cast<const uint64_t *>(&input[i]);
+            unsigned selector = tag >> 3;
+            if (selector >= Predictors::count)
+                throw std::runtime_error("FPC stream names an unknown predictor");
+            if constexpr (instrumentationEnabled)
+                tagCounts[tag & 0x3f]++;
+
+            word actual = predictors.predict(selector) ^ getResidual<word>(in, end, tag & 0x07);
+            predictors.update(actual);
+            return actual;
+        }
 
-            uint64_t first_fcm_prediction = getFcmPrediction();
-            uint64_t first_dfcm_difference_prediction = getDfcmPrediction();
+        // Bitwise copies of input[i - 1] from input[i] on, input[i] being one.
+        static size_t repeats(const T *input, size_t i, size_t count)
+        {
+            word previous, value;
+            memcpy(&previous, &input[i - 1], sizeof(word));
+            size_t end = i + 1;
+            for (; end < count; end++)
+            {
+                memcpy(&value, &input[end], sizeof(word));
+                if (value != previous)
+                    break;
+            }
+            return end - i;
+        }
 
-            bool first_use_fcm = __builtin_clzll(first_true_value ^ first_fcm_prediction) >= __builtin_clzll(first_true_value ^ first_dfcm_difference_prediction);
+        // Runs are rare next to single values, so their code stays out of line
+        // and out of the way of the per-value loops.
+        __attribute__((noinline)) uint8_t *encodeRun(uint8_t *out, word value, size_t run)
+        {
+            for (size_t k = 0; k < fpcMinRun; k++)
+                predictors.update(value);
+            *out++ = 0;
+            return putVarint(out, run - fpcMinRun);
+        }
 
-            updateFcmHash(first_true_value);
-            updateDfcmHash(first_true_value);
+        // Decodes the run after the zero byte at `in` into output[i, count);
+        // returns the index after it.
+        __attribute__((noinline)) size_t decodeRun(const uint8_t *&in, const uint8_t *end, T *output, size_t i, size_t count)
+        {
+            if (i == 0)
+                throw std::runtime_error("FPC run has no value to repeat");
+            in++;
+            uint64_t extra = readVarint(in, end);
+            if (count - i < fpcMinRun || extra > count - i - fpcMinRun)
+                throw std::runtime_error("FPC run is longer than the stream");
+            size_t run = fpcMinRun + (size_t)extra;
+
+            word value;
+            memcpy(&value, &output[i - 1], sizeof(word));
+            for (size_t k = 0; k < run; k++)
+                memcpy(&output[i + k], &value, sizeof(word));
+            for (size_t k = 0; k < fpcMinRun; k++)
+                predictors.update(value);
+            return i + run;
+        }
 
-            uint64_t second_true_value = *reinterpret_cast<const uint64_t *>(&input[i + 1]);
+        // Decodes the value or run behind `tag` into output[i, count); returns
+        // the index after it.
+        inline size_t decodeSlot(uint8_t tag, const uint8_t *&in, const uint8_t *end, T *output, size_t i, size_t count)
+        {
+            if (tag == fpcTraits<T>::runCode && in < end && *in == 0)
+                return decodeRun(in, end, output, i, count);
 
-            uint64_t second_fcm_prediction = getFcmPrediction();
-            uint64_t second_dfcm_difference_prediction = getDfcmPrediction();
+            word actual = decodeValue(tag, in, end);
+            memcpy(&output[i], &actual, sizeof(T));
+            return i + 1;
+        }
 
-            bool second_use_fcm = __builtin_clzll(second_true_value ^ second_fcm_prediction) >= __builtin_clzll(second_true_value ^ second_dfcm_difference_prediction);
+    public:
+        explicit fpcPredictorCoder(unsigned bits)
+            : bits(bits), arena(predictorArena::acquire(Predictors::arenaBytes(bits))), predictors(*arena, bits)
+        {
+        }
 
-            updateFcmHash(second_true_value);
-            updateDfcmHash(second_true_value);
+        // Pooled arenas must go back cleared.
+        ~fpcPredictorCoder() override { predictors.reset(); }
 
-            uint8_t code = 0;
-            if (first_use_fcm)
-            {
+        predictorSet set() const override { return Set; }
+        unsigned tableBits() const override { return bits; }
 
-                uint8_t zeroBytes = encodeZeroBytes(first_true_value ^ first_fcm_prediction);
-                code |= zeroBytes << 4;
-            }
-            else
-            {
-                code |= 0x80;
+        void reset() override { predictors.reset(); }
 
-                int zeroBytes = encodeZeroBytes(first_true_value ^ first_dfcm_difference_prediction);
-                code |= zeroBytes << 4;
-            }
-            if (second_use_fcm)
+        size_t encode(const T *input, size_t count, uint8_t *output) override
+        {
+            stageTimer timer(codecStage::fpcEncode, count * sizeof(T));
+            uint8_t *out = output;
+            // Header byte of a paired set still waiting for its second tag; a
+            // lone last value leaves the low nibble empty.
+            uint8_t *header = nullptr;
+            // Runs are looked for from here on; the values before it were
+            // already found in a repeat too short to code as a run.
+            size_t runFrom = 1;
+            word previous = 0;
+            for (size_t i = 0; i < count;)
             {
+                word true_value;
+                memcpy(&true_value, &input[i], sizeof(word));
+                size_t run = 0;
+                if (true_value == previous && i >= runFrom)
+                {
+                    run = repeats(input, i, count);
+                    runFrom = i + run + 1;
+                }
+                previous = true_value;
 
-                int zeroBytes = encodeZeroBytes(second_true_value ^ second_fcm_prediction);
-                code |= zeroBytes;
-            }
-            else
-            {
-                code |= 0x08;
-                int zeroBytes = encodeZeroBytes(second_true_value ^ second_dfcm_difference_prediction);
-                code |= zeroBytes;
-            }
-            compressed.push_back(code);
+                uint8_t tag;
+                word residual = 0;
+                if (run >= fpcMinRun)
+                    tag = fpcTraits<T>::runCode;
+                else
+                    tag = encodeValue(true_value, residual);
 
-            if (first_use_fcm)
-            {
-                std::vector<uint8_t> byteArrayD = toByteArray(first_true_value ^ first_fcm_prediction);
-                compressed.insert(compressed.end(), byteArrayD.begin(), byteArrayD.end());
-            }
-            else
-            {
-                std::vector<uint8_t> byteArrayD = toByteArray(first_true_value ^ first_dfcm_difference_prediction);
-                compressed.insert(compressed.end(), byteArrayD.begin(), byteArrayD.end());
-            }
+                if constexpr (Predictors::selectorBits == 1)
+                {
+                    if (header)
+                    {
+                        *header |= tag;
+                        header = nullptr;
+                    }
+                    else
+                    {
+                        header = out++;
+                        *header = (uint8_t)(tag << 4);
+                    }
+                }
+                else
+                    *out++ = tag;
 
-            if (second_use_fcm)
-            {
-                std::vector<uint8_t> byteArrayE = toByteArray(second_true_value ^ second_fcm_prediction);
-                compressed.insert(compressed.end(), byteArrayE.begin(), byteArrayE.end());
+                if (run >= fpcMinRun)
+                {
+                    out = encodeRun(out, true_value, run);
+                    i += run;
+                }
+                else
+                {
+                    out = putResidual(out, residual, tag & 0x07);
+                    i++;
+                }
             }
-            else
+            timer.bytesOut = out - output;
+            flushTagCounts();
+            return out - output;
+        }
+
+        void decode(const uint8_t *fpcCpmpreesed, size_t fpcSize, size_t originalSize, T *output) override
+        {
+            stageTimer timer(codecStage::fpcDecode, fpcSize);
+            timer.bytesOut = originalSize * sizeof(T);
+            const uint8_t *in = fpcCpmpreesed;
+            const uint8_t *end = fpcCpmpreesed + fpcSize;
+            for (size_t i = 0; i < originalSize;)
             {
-                std::vector<uint8_t> byteArrayE = toByteArray(second_true_value ^ second_dfcm_difference_prediction);
-                compressed.insert(compressed.end(), byteArrayE.begin(), byteArrayE.end());
+                if (in == end)
+                    throw std::runtime_error("FPC stream is truncated");
+                uint8_t header = *in++;
+
+                i = decodeSlot(Predictors::selectorBits == 1 ? header >> 4 : header, in, end, output, i, originalSize);
+                if (Predictors::selectorBits == 1 && i < originalSize)
+                    i = decodeSlot(header & 0x0f, in, end, output, i, originalSize);
             }
+            flushTagCounts();
         }
+    };
 
-        if (input.size() % 2 != 0)
+    template <typename T>
+    static std::unique_ptr<fpcCoder<T>> makeCoder(predictorSet set, unsigned bits)
+    {
+        switch (set)
         {
-            compressed.push_back(0x00);
+        case predictorSet::fcmDfcm:
+            return std::make_unique<fpcPredictorCoder<T, fcmDfcmPredictors<T>, predictorSet::fcmDfcm>>(bits);
+        case predictorSet::stride:
+            return std::make_unique<fpcPredictorCoder<T, stridePredictors<T>, predictorSet::stride>>(bits);
+        case predictorSet::extrapolating:
+            return std::make_unique<fpcPredictorCoder<T, extrapolatingPredictors<T>, predictorSet::extrapolating>>(bits);
         }
+        throw std::invalid_argument("Unknown predictor set");
+    }
 
-        rans = new RANS::RANS(compressed);
+    static unsigned checkedTableBits(unsigned tableBits)
+    {
+        if (tableBits < minTableBits || tableBits > maxTableBits)
+            throw std::invalid_argument("Predictor table bits must be between " + std::to_string(minTableBits) +
+                                        " and " + std::to_string(maxTableBits));
+        return tableBits;
+    }
+
+    // Rounds `value` to nearest on its low `dropBits` mantissa bits. A carry
+    // out of the mantissa steps the exponent, which is still the nearest value.
+    template <typename T>
+    static T roundMantissa(T value, unsigned dropBits)
+    {
+        using word = typename fpcTraits<T>::word;
+        word bits;
+        memcpy(&bits, &value, sizeof(T));
+        word half = (word)1 << (dropBits - 1);
+        bits = (bits + half) & ~((half << 1) - 1);
+        memcpy(&value, &bits, sizeof(T));
+        return value;
+    }
+
+    // Nearest value within `bound` of `value` with the most trailing zero
+    // mantissa bits. The first guess comes from the exponents; the check runs
+    // on the rounded value so subnormals and carries stay within the bound.
+    template <typename T>
+    static T quantiseValue(T value, double bound)
+    {
+        constexpr int mantissaBits = std::numeric_limits<T>::digits - 1;
+        if (!std::isfinite(value) || value == 0 || !(bound > 0))
+            return value;
+
+        int valueExponent, boundExponent;
+        std::frexp(value, &valueExponent);
+        std::frexp(bound, &boundExponent);
+        // The unit in the last place is 2^(valueExponent - 1 - mantissaBits) and
+        // rounding on k bits moves the value by at most 2^(k - 1) of them.
+        int dropBits = std::clamp(boundExponent - valueExponent + mantissaBits + 1, 0, mantissaBits);
+        for (; dropBits > 0; dropBits--)
+        {
+            T rounded = roundMantissa(value, dropBits);
+            if (std::isfinite(rounded) && std::fabs((double)rounded - (double)value) <= bound)
+                return rounded;
+        }
+        return value;
+    }
 
-        auto encoded = rans->encode();
-        return {encoded, compressed.size()};
+    template <typename T>
+    static void quantise(std::vector<T> &values, errorBoundMode mode, double bound)
+    {
+        if constexpr (std::is_floating_point<T>::value)
+        {
+            for (T &value : values)
+                value = quantiseValue(value, mode == errorBoundMode::relative ? bound * std::fabs((double)value) : bound);
+        }
     }
 
-    std::vector<float> compressorDecompressor::decompress(std::vector<uint8_t> &compressed, size_t originalSize, size_t compressedSize)
+    template <typename T>
+    compressorDecompressor<T>::compressorDecompressor(predictorSet predictors, unsigned tableBits)
+        : predictors(predictors), tableBits(checkedTableBits(tableBits)), frames(std::make_unique<FrameContext>())
     {
+        coderFor(predictors, tableBits);
+    }
 
-        auto fpcCpmpreesed = rans->decode(compressed, compressedSize);
+    template <typename T>
+    compressorDecompressor<T>::~compressorDecompressor() = default;
 
-        std::vector<float> decompressed;
-        size_t bufferIndex = 0;
-        reset();
-        for (size_t i = 0; i < originalSize; i += 2)
+    template <typename T>
+    fpcCoder<T> &compressorDecompressor<T>::coderFor(predictorSet set, unsigned bits)
+    {
+        if (!coder || coder->set() != set || coder->tableBits() != bits)
         {
-            uint8_t header = fpcCpmpreesed[bufferIndex++];
-            uint64_t prediction;
+            coder.reset();
+            coder = makeCoder<T>(set, bits);
+        }
+        return *coder;
+    }
 
-            if ((header & 0x80) != 0)
-            {
-                prediction = getDfcmPrediction();
-            }
-            else
+    template <typename T>
+    fpcCoder<T> &compressorDecompressor<T>::frameCoderFor(predictorSet set, unsigned bits)
+    {
+        // One per predictor set covers a service whose clients each keep to theirs.
+        constexpr size_t cachedCoders = 3;
+        for (size_t i = 0; i < frameCoders.size(); i++)
+        {
+            if (frameCoders[i]->set() == set && frameCoders[i]->tableBits() == bits)
             {
-                prediction = getFcmPrediction();
+                std::rotate(frameCoders.begin(), frameCoders.begin() + i, frameCoders.begin() + i + 1);
+                return *frameCoders.front();
             }
+        }
 
-            int numZeroBytes = (header & 0x70) >> 4;
-            if (numZeroBytes > 3)
-            {
-                numZeroBytes++;
-            }
+        // The least recent coder goes first, so its arena is back in the pool
+        // for the new one.
+        if (frameCoders.size() == cachedCoders)
+            frameCoders.pop_back();
+        frameCoders.insert(frameCoders.begin(), makeCoder<T>(set, bits));
+        return *frameCoders.front();
+    }
 
-            size_t diffSize = 8 - numZeroBytes;
-            std::vector<uint8_t> dst(diffSize);
-            for (size_t j = 0; j < diffSize; ++j)
-            {
-                dst[j] = fpcCpmpreesed[bufferIndex++];
-            }
-            int64_t diff = toLong(dst);
-            int64_t actual = prediction ^ diff;
+    template <typename T>
+    void compressorDecompressor<T>::setPredictorSet(predictorSet predictors)
+    {
+        this->predictors = predictors;
+        coderFor(predictors, tableBits);
+    }
 
-            updateFcmHash(actual);
-            updateDfcmHash(actual);
-            decompressed.push_back(*reinterpret_cast<float *>(&actual));
+    template <typename T>
+    void compressorDecompressor<T>::setTableBits(unsigned tableBits)
+    {
+        this->tableBits = checkedTableBits(tableBits);
+        coderFor(predictors, tableBits);
+    }
 
-            if ((header & 0x08) != 0)
+    template <typename T>
+    void compressorDecompressor<T>::setErrorBound(errorBoundMode mode, double bound)
+    {
+        if (!(bound >= 0))
+            throw std::invalid_argument("Error bound must be a non-negative number");
+        if (mode != errorBoundMode::lossless && !std::is_floating_point<T>::value)
+            throw std::invalid_argument("Error bounds apply to floating-point values only");
+        boundMode = mode;
+        this->bound = mode == errorBoundMode::lossless ? 0 : bound;
+    }
+
+    template <typename T>
+    void compressorDecompressor<T>::reset()
+    {
+        coderFor(predictors, tableBits).reset();
+    }
+
+    template <typename T>
+    size_t compressorDecompressor<T>::fpcBound(size_t count)
+    {
+        return count * (1 + sizeof(word)) + sizeof(word);
+    }
+
+    template <typename T>
+    template <typename F>
+    auto compressorDecompressor<T>::instrumented(F &&body) -> decltype(body())
+    {
+        if constexpr (!instrumentationEnabled)
+        {
+            return body();
+        }
+        else
+        {
+            codecStats call;
+            statsScope scope(call);
+            auto finish = [&] {
+                if (!scope.isOutermost())
+                    return;
+                stats.merge(call);
+                if (statsCallback)
+                    statsCallback(call);
+            };
+            if constexpr (std::is_void<decltype(body())>::value)
             {
-                prediction = getDfcmPrediction();
+                body();
+                finish();
             }
             else
             {
-                prediction = getFcmPrediction();
+                auto result = body();
+                finish();
+                return result;
             }
-            numZeroBytes = (header & 0x07);
-            if (numZeroBytes > 3)
-                numZeroBytes++;
-
-            // Extract bytes for second diff
-            diffSize = 8 - numZeroBytes;
-            dst.resize(diffSize);
-            for (size_t j = 0; j < diffSize; ++j)
+        }
+    }
+
+    template <typename T>
+    size_t compressorDecompressor<T>::encodeValues(const T *input, size_t count, uint8_t *output)
+    {
+        return instrumented([&] { return coderFor(predictors, tableBits).encode(input, count, output); });
+    }
+
+    template <typename T>
+    void compressorDecompressor<T>::encodeValues(const T *input, size_t count, std::vector<uint8_t> &compressed)
+    {
+        size_t start = compressed.size();
+        compressed.resize(start + fpcBound(count));
+        compressed.resize(start + encodeValues(input, count, compressed.data() + start));
+    }
+
+    template <typename T>
+    void compressorDecompressor<T>::decodeValues(const uint8_t *fpcCpmpreesed, size_t fpcSize, size_t originalSize, T *output)
+    {
+        instrumented([&] { coderFor(predictors, tableBits).decode(fpcCpmpreesed, fpcSize, originalSize, output); });
+    }
+
+    template <typename T>
+    const T *compressorDecompressor<T>::boundedValues(const T *input, size_t count, uint8_t &flags)
+    {
+        if (boundMode == errorBoundMode::lossless)
+            return input;
+
+        roundedScratch.assign(input, input + count);
+        quantise(roundedScratch, boundMode, bound);
+        flags |= frameFlagLossy;
+        return roundedScratch.data();
+    }
+
+    template <typename T>
+    size_t compressorDecompressor<T>::compressFpc(const T *values, size_t count)
+    {
+        reset();
+        if (fpcScratch.size() < fpcBound(count))
+            fpcScratch.resize(fpcBound(count));
+        return encodeValues(values, count, fpcScratch.data());
+    }
+
+    // Order-0 coded size of `scale` times as many bytes like these `size`,
+    // frequency table included.
+    static double order0Estimate(const uint8_t *bytes, size_t size, double scale)
+    {
+        uint32_t counts[256] = {};
+        for (size_t i = 0; i < size; i++)
+            counts[bytes[i]]++;
+
+        double bits = 0;
+        unsigned used = 0;
+        for (uint32_t count : counts)
+        {
+            if (count == 0)
+                continue;
+            bits += count * std::log2((double)size / count);
+            used++;
+        }
+        return bits / 8 * scale + 32 + 1.5 * used;
+    }
+
+    template <typename T>
+    valueCodec compressorDecompressor<T>::chooseCodec(const T *values, size_t count, size_t &fpcSize)
+    {
+        // Four runs of 256 values spread over the call; the predictors need
+        // neighbours, so the runs are contiguous.
+        constexpr size_t sampleRuns = 4, sampleRunLength = 256, sampleValues = sampleRuns * sampleRunLength;
+        constexpr unsigned samplingTableBits = 12;
+        if (count == 0)
+            return valueCodec::raw;
+
+        const T *sample = values;
+        size_t sampleCount = count;
+        const uint8_t *sampleBytes;
+        size_t sampleFpcSize;
+        if (count <= sampleValues)
+        {
+            fpcSize = compressFpc(values, count);
+            sampleBytes = fpcScratch.data();
+            sampleFpcSize = fpcSize;
+        }
+        else
+        {
+            sampleScratch.resize(sampleValues);
+            for (size_t run = 0; run < sampleRuns; run++)
             {
-                dst[j] = fpcCpmpreesed[bufferIndex++];
+                size_t first = run * (count - sampleRunLength) / (sampleRuns - 1);
+                std::copy(values + first, values + first + sampleRunLength, sampleScratch.begin() + run * sampleRunLength);
             }
-            diff = toLong(dst);
+            sample = sampleScratch.data();
+            sampleCount = sampleValues;
+
+            if (!samplingCoder || samplingCoder->set() != predictors)
+                samplingCoder = makeCoder<T>(predictors, samplingTableBits);
+            samplingCoder->reset();
+            sampleFpc.resize(fpcBound(sampleValues));
+            sampleFpcSize = samplingCoder->encode(sample, sampleCount, sampleFpc.data());
+            sampleBytes = sampleFpc.data();
+        }
 
-            // Special case for termination
-            if (numZeroBytes == 7 && diff == 0)
+        xorScratch.resize(std::max(xorScratch.size(), xorBound<T>(sampleCount)));
+        double scale = (double)count / sampleCount;
+        const std::pair<valueCodec, double> byCost[] = {
+            {valueCodec::raw, (double)count * sizeof(T)},
+            {valueCodec::xorBits, xorEncode(sample, sampleCount, xorScratch.data()) * scale},
+            {valueCodec::fpcOnly, sampleFpcSize * scale},
+            {valueCodec::fpcEntropy, order0Estimate(sampleBytes, sampleFpcSize, scale)},
+        };
+
+        valueCodec chosen = byCost[0].first;
+        double chosenSize = byCost[0].second;
+        for (const auto &[candidate, size] : byCost)
+        {
+            if (size < chosenSize - chosenSize / 32)
             {
-                return {};
+                chosen = candidate;
+                chosenSize = size;
             }
+        }
+        return chosen;
+    }
 
-            actual = prediction ^ diff;
+    template <typename T>
+    size_t compressorDecompressor<T>::encodeFrameAs(valueCodec chosen, const T *values, size_t count, uint8_t flags, size_t fpcSize,
+                                                    uint8_t *output, size_t capacity)
+    {
+        frameHeader header;
+        header.flags = flags | valueCodecFrameFlags(chosen);
+        header.valueType = valueTypeCode<T>::value;
+        header.predictors = (uint8_t)predictors;
+        header.tableBits = (uint8_t)tableBits;
+        header.elementCount = count;
+
+        switch (chosen)
+        {
+        case valueCodec::raw:
+            return frames->encodePlain(header, reinterpret_cast<const uint8_t *>(values), count * sizeof(T), output, capacity);
+        case valueCodec::xorBits:
+        {
+            xorScratch.resize(std::max(xorScratch.size(), xorBound<T>(count)));
+            size_t size = xorEncode(values, count, xorScratch.data());
+            return frames->encodePlain(header, xorScratch.data(), size, output, capacity);
+        }
+        default:
+            break;
+        }
 
-            // Update predictors and decode the second value
-            updateFcmHash(actual);
-            updateDfcmHash(actual);
-            decompressed.push_back(*reinterpret_cast<float *>(&actual));
+        if (fpcSize == 0)
+            fpcSize = compressFpc(values, count);
+        if (chosen == valueCodec::fpcOnly)
+        {
+            header.fpcSize = fpcSize;
+            return frames->encodePlain(header, fpcScratch.data(), fpcSize, output, capacity);
         }
+        return frames->encode(fpcScratch.data(), fpcSize, count, header.valueType, flags | entropyFrameFlags(backend), header.predictors,
+                              header.tableBits, output, capacity);
+    }
+
+    template <typename T>
+    size_t compressorDecompressor<T>::compressBound(size_t count)
+    {
+        return std::max(frameBound(fpcBound(count)), plainFrameBound(xorBound<T>(count)));
+    }
 
-        return decompressed;
+    template <typename T>
+    std::vector<uint8_t> compressorDecompressor<T>::compress(const std::vector<T> &input)
+    {
+        std::vector<uint8_t> frame(compressBound(input.size()));
+        frame.resize(compress(input.data(), input.size(), frame.data(), frame.size()));
+        frame.shrink_to_fit();
+        return frame;
+    }
+
+    template <typename T>
+    size_t compressorDecompressor<T>::compress(const T *input, size_t count, uint8_t *output, size_t capacity)
+    {
+        return instrumented([&] {
+            uint8_t flags = 0;
+            const T *values = boundedValues(input, count, flags);
+            if (codec != valueCodec::automatic)
+                return encodeFrameAs(codec, values, count, flags, 0, output, capacity);
+
+            // The estimates can miss; a frame larger than the raw values gives way to them.
+            size_t fpcSize = 0;
+            valueCodec chosen = chooseCodec(values, count, fpcSize);
+            size_t size = encodeFrameAs(chosen, values, count, flags, fpcSize, output, capacity);
+            if (chosen != valueCodec::raw && size > plainFrameBound(count * sizeof(T)))
+                size = encodeFrameAs(valueCodec::raw, values, count, flags, 0, output, capacity);
+            return size;
+        });
     }
+
+    template <typename T>
+    std::vector<T> compressorDecompressor<T>::decompress(const std::vector<uint8_t> &frame)
+    {
+        return decompress(frame.data(), frame.size());
+    }
+
+    template <typename T>
+    const frameView &compressorDecompressor<T>::parseValueFrame(const uint8_t *frame, size_t size)
+    {
+        const frameView &view = frames->parse(frame, size);
+        if (view.header.valueType != valueTypeCode<T>::value)
+            throw std::runtime_error("Frame holds a different value type");
+        if (view.header.flags & frameFlagContinued)
+            throw std::runtime_error("Frame continues a stream; decode it with StreamDecompressor");
+        return view;
+    }
+
+    template <typename T>
+    void compressorDecompressor<T>::decodeFrameValues(const frameView &view, T *output)
+    {
+        size_t count = view.header.elementCount;
+        const uint8_t *fpc = view.payload;
+        switch (frameValueCodec(view.header.flags))
+        {
+        case valueCodec::raw:
+            if (view.payloadSize > 0)
+                std::memcpy(output, view.payload, view.payloadSize);
+            return;
+        case valueCodec::xorBits:
+            xorDecode(view.payload, view.payloadSize, count, output);
+            return;
+        case valueCodec::fpcEntropy:
+            if (fpcScratch.size() < view.header.fpcSize)
+                fpcScratch.resize(view.header.fpcSize);
+            frames->decodeFpc(view, fpcScratch.data());
+            fpc = fpcScratch.data();
+            break;
+        default:
+            break;
+        }
+
+        fpcCoder<T> &frameCoder = frameCoderFor(predictorSetFromCode(view.header.predictors), frameTableBits(view.header.tableBits));
+        frameCoder.reset();
+        frameCoder.decode(fpc, view.header.fpcSize, count, output);
+    }
+
+    template <typename T>
+    std::vector<T> compressorDecompressor<T>::decompress(const uint8_t *frame, size_t size)
+    {
+        return instrumented([&] {
+            const frameView &view = parseValueFrame(frame, size);
+            std::vector<T> decompressed(view.header.elementCount);
+            decodeFrameValues(view, decompressed.data());
+            return decompressed;
+        });
+    }
+
+    template <typename T>
+    size_t compressorDecompressor<T>::decompress(const uint8_t *frame, size_t size, T *output, size_t capacity)
+    {
+        return instrumented([&] {
+            const frameView &view = parseValueFrame(frame, size);
+            if (view.header.elementCount > capacity)
+                throw std::invalid_argument("Frame holds more values than the output buffer");
+            decodeFrameValues(view, output);
+            return (size_t)view.header.elementCount;
+        });
+    }
+
+    template class compressorDecompressor<float>;
+    template class compressorDecompressor<double>;
+    template class compressorDecompressor<uint32_t>;
+    template class compressorDecompressor<uint64_t>;
 }
\ No newline at end of file
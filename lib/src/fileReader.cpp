@@ -2,6 +2,17 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 
 CSVReader::CSVReader(const std::string &file) : filename(file)
@@ -83,3 +94,360 @@ std::vector<float> convertToFloat(const std::vector<std::string> &stringColumn)
     }
     return floatColumn;
 }
+
+MappedCSVReader::MappedCSVReader(const std::string &file) : filename(file)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Could not open file: " + filename);
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        close(fd);
+        throw std::runtime_error("Could not stat file: " + filename);
+    }
+
+    mappedSize = info.st_size;
+    if (mappedSize > 0)
+    {
+        void *mapping = mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED)
+        {
+            close(fd);
+            throw std::runtime_error("Could not map file: " + filename);
+        }
+        madvise(mapping, mappedSize, MADV_SEQUENTIAL);
+        begin = static_cast<const char *>(mapping);
+        end = begin + mappedSize;
+    }
+    close(fd);
+}
+
+MappedCSVReader::~MappedCSVReader()
+{
+    if (begin)
+    {
+        munmap(const_cast<char *>(begin), mappedSize);
+    }
+}
+
+// Next ',' or '\n' at or after p, or end. SSE2 compares 16 bytes per step.
+static const char *findDelimiter(const char *p, const char *end)
+{
+#if defined(__SSE2__)
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i newline = _mm_set1_epi8('\n');
+    while (end - p >= 16)
+    {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, comma), _mm_cmpeq_epi8(chunk, newline)));
+        if (mask)
+        {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+#endif
+    while (p < end && *p != ',' && *p != '\n')
+    {
+        p++;
+    }
+    return p;
+}
+
+static const char *findLineEnd(const char *p, const char *end)
+{
+    const void *newline = memchr(p, '\n', end - p);
+    return newline ? static_cast<const char *>(newline) : end;
+}
+
+std::vector<std::string> MappedCSVReader::header() const
+{
+    std::vector<std::string> cells;
+    if (!begin)
+    {
+        return cells;
+    }
+
+    const char *lineEnd = findLineEnd(begin, end);
+    const char *p = begin;
+    for (;;)
+    {
+        const char *cellEnd = findDelimiter(p, lineEnd);
+        const char *trimmed = cellEnd;
+        if (trimmed > p && trimmed[-1] == '\r')
+        {
+            trimmed--;
+        }
+        cells.emplace_back(p, trimmed);
+        if (cellEnd == lineEnd)
+        {
+            break;
+        }
+        p = cellEnd + 1;
+    }
+    return cells;
+}
+
+// Parses one cell the way convertToFloat() would; false for a missing or non-numeric cell.
+static bool parseFloatCell(const char *cell, const char *cellEnd, float &value)
+{
+    while (cell < cellEnd && (*cell == ' ' || *cell == '\t'))
+    {
+        cell++;
+    }
+    if (cell < cellEnd && *cell == '+')
+    {
+        cell++;
+    }
+
+    auto result = std::from_chars(cell, cellEnd, value);
+    return result.ec == std::errc() && result.ptr != cell;
+}
+
+std::vector<float> MappedCSVReader::readFloatColumn(size_t columnIndex) const
+{
+    std::vector<float> column;
+    if (!begin)
+    {
+        return column;
+    }
+
+    const char *line = findLineEnd(begin, end);
+    while (line < end)
+    {
+        line++;
+        const char *lineEnd = findLineEnd(line, end);
+
+        const char *cell = line;
+        size_t index = 0;
+        while (index < columnIndex && cell < lineEnd)
+        {
+            cell = findDelimiter(cell, lineEnd) + 1;
+            index++;
+        }
+
+        float value;
+        if (index == columnIndex && cell <= lineEnd && parseFloatCell(cell, findDelimiter(cell, lineEnd), value))
+        {
+            column.push_back(value);
+        }
+        line = lineEnd;
+    }
+    return column;
+}
+
+std::vector<float> MappedCSVReader::readFloatColumnByName(const std::string &columnName) const
+{
+    std::vector<std::string> names = header();
+    auto it = std::find(names.begin(), names.end(), columnName);
+    if (it == names.end())
+    {
+        return {};
+    }
+    return readFloatColumn(std::distance(names.begin(), it));
+}
+
+std::vector<std::vector<float>> MappedCSVReader::readFloatColumns(const std::vector<size_t> &columnIndices) const
+{
+    std::vector<std::vector<float>> columns(columnIndices.size());
+    if (!begin || columnIndices.empty())
+    {
+        return columns;
+    }
+
+    // Output slots of every column up to the last one requested; a column
+    // requested twice is parsed once and copied at the end.
+    size_t lastColumn = *std::max_element(columnIndices.begin(), columnIndices.end());
+    std::vector<long> slotOf(lastColumn + 1, -1);
+    for (size_t i = 0; i < columnIndices.size(); i++)
+    {
+        if (slotOf[columnIndices[i]] < 0)
+        {
+            slotOf[columnIndices[i]] = (long)i;
+        }
+    }
+
+    const char *line = findLineEnd(begin, end);
+    while (line < end)
+    {
+        line++;
+        const char *lineEnd = findLineEnd(line, end);
+
+        const char *cell = line;
+        for (size_t index = 0; index <= lastColumn && cell <= lineEnd; index++)
+        {
+            const char *cellEnd = findDelimiter(cell, lineEnd);
+            float value;
+            if (slotOf[index] >= 0 && parseFloatCell(cell, cellEnd, value))
+            {
+                columns[slotOf[index]].push_back(value);
+            }
+            cell = cellEnd + 1;
+        }
+        line = lineEnd;
+    }
+
+    for (size_t i = 0; i < columnIndices.size(); i++)
+    {
+        if (slotOf[columnIndices[i]] != (long)i)
+        {
+            columns[i] = columns[slotOf[columnIndices[i]]];
+        }
+    }
+    return columns;
+}
+
+// Header index of every name; throws std::out_of_range for one that is missing.
+static std::vector<size_t> columnIndicesOf(const std::vector<std::string> &names, const std::vector<std::string> &columnNames,
+                                           const std::string &filename)
+{
+    std::vector<size_t> columnIndices;
+    for (const auto &columnName : columnNames)
+    {
+        auto it = std::find(names.begin(), names.end(), columnName);
+        if (it == names.end())
+        {
+            throw std::out_of_range("No column named " + columnName + " in " + filename);
+        }
+        columnIndices.push_back(std::distance(names.begin(), it));
+    }
+    return columnIndices;
+}
+
+std::vector<std::vector<float>> MappedCSVReader::readFloatColumnsByName(const std::vector<std::string> &columnNames) const
+{
+    return readFloatColumns(columnIndicesOf(header(), columnNames, filename));
+}
+
+std::vector<std::vector<float>> MappedCSVReader::readFloatRows(const std::vector<size_t> &columnIndices) const
+{
+    std::vector<std::vector<float>> columns(columnIndices.size());
+    if (!begin || columnIndices.empty())
+    {
+        return columns;
+    }
+
+    size_t lastColumn = *std::max_element(columnIndices.begin(), columnIndices.end());
+    std::vector<float> row(lastColumn + 1);
+    std::vector<bool> wanted(lastColumn + 1, false);
+    for (size_t index : columnIndices)
+    {
+        wanted[index] = true;
+    }
+
+    const char *line = findLineEnd(begin, end);
+    while (line < end)
+    {
+        line++;
+        const char *lineEnd = findLineEnd(line, end);
+        if (line == lineEnd || (lineEnd - line == 1 && *line == '\r'))
+        {
+            line = lineEnd;
+            continue;
+        }
+
+        std::fill(row.begin(), row.end(), NAN);
+        const char *cell = line;
+        for (size_t index = 0; index <= lastColumn && cell <= lineEnd; index++)
+        {
+            const char *cellEnd = findDelimiter(cell, lineEnd);
+            float value;
+            if (wanted[index] && parseFloatCell(cell, cellEnd, value))
+            {
+                row[index] = value;
+            }
+            cell = cellEnd + 1;
+        }
+        for (size_t i = 0; i < columnIndices.size(); i++)
+        {
+            columns[i].push_back(row[columnIndices[i]]);
+        }
+        line = lineEnd;
+    }
+    return columns;
+}
+
+std::vector<std::vector<float>> MappedCSVReader::readFloatRowsByName(const std::vector<std::string> &columnNames) const
+{
+    return readFloatRows(columnIndicesOf(header(), columnNames, filename));
+}
+
+// A number with nothing after it but blanks; false for a blank cell too.
+static bool isNumericCell(const char *cell, const char *cellEnd)
+{
+    while (cell < cellEnd && (*cell == ' ' || *cell == '\t'))
+    {
+        cell++;
+    }
+    if (cell < cellEnd && *cell == '+')
+    {
+        cell++;
+    }
+
+    float value;
+    auto result = std::from_chars(cell, cellEnd, value);
+    if (result.ec != std::errc() || result.ptr == cell)
+    {
+        return false;
+    }
+    const char *rest = result.ptr;
+    while (rest < cellEnd && (*rest == ' ' || *rest == '\t' || *rest == '\r'))
+    {
+        rest++;
+    }
+    return rest == cellEnd;
+}
+
+static bool isBlankCell(const char *cell, const char *cellEnd)
+{
+    while (cell < cellEnd && (*cell == ' ' || *cell == '\t' || *cell == '\r'))
+    {
+        cell++;
+    }
+    return cell == cellEnd;
+}
+
+std::vector<size_t> MappedCSVReader::numericColumns() const
+{
+    size_t columnCount = header().size();
+    std::vector<bool> seen(columnCount, false);
+    std::vector<bool> rejected(columnCount, false);
+    if (begin)
+    {
+        const char *line = findLineEnd(begin, end);
+        while (line < end)
+        {
+            line++;
+            const char *lineEnd = findLineEnd(line, end);
+            const char *cell = line;
+            for (size_t index = 0; index < columnCount && cell <= lineEnd; index++)
+            {
+                const char *cellEnd = findDelimiter(cell, lineEnd);
+                if (isNumericCell(cell, cellEnd))
+                {
+                    seen[index] = true;
+                }
+                else if (!isBlankCell(cell, cellEnd))
+                {
+                    rejected[index] = true;
+                }
+                cell = cellEnd + 1;
+            }
+            line = lineEnd;
+        }
+    }
+
+    std::vector<size_t> numeric;
+    for (size_t index = 0; index < columnCount; index++)
+    {
+        if (seen[index] && !rejected[index])
+        {
+            numeric.push_back(index);
+        }
+    }
+    return numeric;
+}
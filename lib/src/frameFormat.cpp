@@ -0,0 +1,598 @@
+#include "frameFormat.hpp"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+namespace compression
+{
+    void writeVarint(std::vector<uint8_t> &out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back((uint8_t)(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back((uint8_t)value);
+    }
+
+    uint64_t readVarint(const uint8_t *&in, const uint8_t *end)
+    {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            if (in == end)
+                throw std::runtime_error("Truncated varint in frame");
+            uint8_t byte = *in++;
+            value |= (uint64_t)(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return value;
+        }
+        throw std::runtime_error("Overlong varint in frame");
+    }
+
+    void writeU32(std::vector<uint8_t> &out, uint32_t value)
+    {
+        for (int i = 0; i < 4; i++)
+            out.push_back((uint8_t)(value >> (i * 8)));
+    }
+
+    uint32_t readU32(const uint8_t *in)
+    {
+        uint32_t value = 0;
+        for (int i = 0; i < 4; i++)
+            value |= (uint32_t)in[i] << (i * 8);
+        return value;
+    }
+
+    struct crcTable
+    {
+        uint32_t entries[256];
+
+        crcTable()
+        {
+            for (uint32_t i = 0; i < 256; i++)
+            {
+                uint32_t c = i;
+                for (int k = 0; k < 8; k++)
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                entries[i] = c;
+            }
+        }
+    };
+
+    static const crcTable crcEntries;
+
+    uint32_t crc32(const uint8_t *data, size_t size, uint32_t crc)
+    {
+        const uint32_t *table = crcEntries.entries;
+        crc = ~crc;
+        for (size_t i = 0; i < size; i++)
+            crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    unsigned valueTypeWordBytes(uint8_t valueType)
+    {
+        switch (valueType)
+        {
+        case valueTypeCode<float>::value:
+        case valueTypeCode<uint32_t>::value:
+            return 4;
+        case valueTypeCode<double>::value:
+        case valueTypeCode<uint64_t>::value:
+            return 8;
+        }
+        throw std::runtime_error("Unknown value type " + std::to_string(valueType) + " in frame");
+    }
+
+    unsigned frameTableBits(uint8_t tableBits)
+    {
+        if (tableBits < minTableBits || tableBits > maxTableBits)
+            throw std::runtime_error("Frame uses unsupported predictor table bits " + std::to_string(tableBits));
+        return tableBits;
+    }
+
+    void writeFrequencyTable(std::vector<uint8_t> &out, const RANS::SymbolStats &stats)
+    {
+        uint8_t present[32] = {0};
+        for (int s = 0; s < 256; s++)
+        {
+            if (stats.commulativeFrequency[s + 1] != stats.commulativeFrequency[s])
+                present[s >> 3] |= (uint8_t)(1 << (s & 7));
+        }
+        out.insert(out.end(), present, present + 32);
+
+        for (int s = 0; s < 256; s++)
+        {
+            uint32_t frequency = stats.commulativeFrequency[s + 1] - stats.commulativeFrequency[s];
+            if (frequency)
+                writeVarint(out, frequency - 1);
+        }
+    }
+
+    RANS::SymbolStats readFrequencyTable(const uint8_t *&in, const uint8_t *end, uint32_t scale)
+    {
+        RANS::SymbolStats stats;
+        readFrequencyTable(in, end, scale, stats);
+        return stats;
+    }
+
+    void readFrequencyTable(const uint8_t *&in, const uint8_t *end, uint32_t scale, RANS::SymbolStats &stats)
+    {
+        if (end - in < 32)
+            throw std::runtime_error("Truncated frequency table in frame");
+
+        const uint8_t *present = in;
+        in += 32;
+
+        for (int s = 0; s < 256; s++)
+            stats.frequencyArray[s] = present[s >> 3] & (1 << (s & 7)) ? (uint32_t)readVarint(in, end) + 1 : 0;
+        stats.calculateCummulativeFrequency();
+
+        if (stats.commulativeFrequency[256] != scale)
+            throw std::runtime_error("Frequency table in frame is not normalised");
+    }
+
+    void writeContextTables(std::vector<uint8_t> &out, const std::vector<RANS::SymbolStats> &contextStats)
+    {
+        uint32_t used = 0;
+        for (size_t context = 0; context < contextStats.size(); context++)
+        {
+            if (contextStats[context].commulativeFrequency[256] != 0)
+                used |= 1u << context;
+        }
+        writeVarint(out, used);
+
+        for (size_t context = 0; context < contextStats.size(); context++)
+        {
+            if (used & (1u << context))
+                writeFrequencyTable(out, contextStats[context]);
+        }
+    }
+
+    std::vector<RANS::SymbolStats> readContextTables(const uint8_t *&in, const uint8_t *end)
+    {
+        std::vector<RANS::SymbolStats> contextStats;
+        readContextTables(in, end, contextStats);
+        return contextStats;
+    }
+
+    void readContextTables(const uint8_t *&in, const uint8_t *end, std::vector<RANS::SymbolStats> &contextStats)
+    {
+        uint64_t used = readVarint(in, end);
+        if (used >> RANS::maxContexts)
+            throw std::runtime_error("Context table mask in frame names unknown contexts");
+
+        contextStats.resize(RANS::maxContexts);
+        for (uint32_t context = 0; context < RANS::maxContexts; context++)
+        {
+            RANS::SymbolStats &table = contextStats[context];
+            if (used & (1u << context))
+            {
+                readFrequencyTable(in, end, RANS::context_prob_scale, table);
+            }
+            else
+            {
+                std::fill(table.frequencyArray.begin(), table.frequencyArray.end(), 0);
+                std::fill(table.commulativeFrequency.begin(), table.commulativeFrequency.end(), 0);
+            }
+        }
+    }
+
+    // Fields up to and including the entropy model, which `writeModel` appends.
+    template <typename ModelWriter>
+    static void writeFrameHead(std::vector<uint8_t> &frame, const frameHeader &header, ModelWriter writeModel)
+    {
+        for (int i = 0; i < 4; i++)
+            frame.push_back((uint8_t)(frameMagic >> (i * 8)));
+        frame.push_back(frameVersion);
+        frame.push_back(header.flags);
+        frame.push_back(header.valueType);
+        frame.push_back(header.predictors);
+        frame.push_back(header.tableBits);
+        writeVarint(frame, header.elementCount);
+        writeVarint(frame, header.fpcSize);
+        writeModel(frame);
+    }
+
+    static void appendCrc(uint8_t *frame, size_t size)
+    {
+        uint32_t crc = crc32(frame, size);
+        for (int i = 0; i < 4; i++)
+            frame[size + i] = (uint8_t)(crc >> (i * 8));
+    }
+
+    // Writes everything around the entropy model, which `writeModel` appends.
+    template <typename ModelWriter>
+    static std::vector<uint8_t> assembleFrame(const frameHeader &header, ModelWriter writeModel, const std::vector<uint8_t> &payload)
+    {
+        std::vector<uint8_t> frame;
+        frame.reserve(payload.size() + 320);
+
+        writeFrameHead(frame, header, writeModel);
+        writeVarint(frame, payload.size());
+        frame.insert(frame.end(), payload.begin(), payload.end());
+
+        size_t size = frame.size();
+        frame.resize(size + 4);
+        appendCrc(frame.data(), size);
+        return frame;
+    }
+
+    std::vector<uint8_t> buildFrame(const frameHeader &header, const RANS::SymbolStats &stats, const std::vector<uint8_t> &payload)
+    {
+        return assembleFrame(header, [&](std::vector<uint8_t> &out) { writeFrequencyTable(out, stats); }, payload);
+    }
+
+    std::vector<uint8_t> buildFrame(const frameHeader &header, const std::vector<RANS::SymbolStats> &contextStats,
+                                    const std::vector<uint8_t> &payload)
+    {
+        return assembleFrame(header, [&](std::vector<uint8_t> &out) { writeContextTables(out, contextStats); }, payload);
+    }
+
+    static uint32_t frameScaleBits(uint8_t flags)
+    {
+        return flags & frameFlagCompactTable ? RANS::compact_prob_bits : RANS::prob_bits;
+    }
+
+    frameView parseFrame(const uint8_t *frame, size_t size)
+    {
+        frameView view;
+        parseFrame(frame, size, view);
+        return view;
+    }
+
+    // Reads the fixed header fields and returns the position just past them.
+    // The checksum is only verified when `checkCrc` is set.
+    static const uint8_t *readFrameHeader(const uint8_t *frame, size_t size, bool checkCrc, frameHeader &header)
+    {
+        if (size < 4 + 3 + 4)
+            throw std::runtime_error("Frame is too short");
+
+        uint32_t magic = 0, storedCrc = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            magic |= (uint32_t)frame[i] << (i * 8);
+            storedCrc |= (uint32_t)frame[size - 4 + i] << (i * 8);
+        }
+        if (magic != frameMagic)
+            throw std::runtime_error("Not an FPC frame (bad magic)");
+        uint8_t version = frame[4];
+        if (version < 2 || version > frameVersion)
+            throw std::runtime_error("Unsupported frame version " + std::to_string(version));
+        if (checkCrc && crc32(frame, size - 4) != storedCrc)
+            throw std::runtime_error("Frame checksum mismatch");
+
+        const uint8_t *in = frame + 7;
+        const uint8_t *end = frame + size - 4;
+
+        header = frameHeader();
+        header.flags = frame[5];
+        header.valueType = frame[6];
+        if (version >= 3)
+        {
+            if (end - in < version - 2)
+                throw std::runtime_error("Frame is too short");
+            header.predictors = *in++;
+            if (version >= 4)
+                header.tableBits = *in++;
+        }
+        header.elementCount = readVarint(in, end);
+        header.fpcSize = readVarint(in, end);
+        return in;
+    }
+
+    uint64_t frameElementCount(const uint8_t *frame, size_t size)
+    {
+        frameHeader header;
+        readFrameHeader(frame, size, false, header);
+        return header.elementCount;
+    }
+
+    void parseFrame(const uint8_t *frame, size_t size, frameView &view)
+    {
+        const uint8_t *in = readFrameHeader(frame, size, true, view.header);
+        const uint8_t *end = frame + size - 4;
+        uint8_t version = frame[4];
+
+        valueCodec codec = frameValueCodec(view.header.flags);
+        if (codec != valueCodec::fpcEntropy)
+        {
+            const uint8_t entropyFlags = frameFlagContinued | frameFlagContextModel | frameFlagCompactTable | frameFlagSplitStreams;
+            if (version < 5 || (view.header.flags & entropyFlags))
+                throw std::runtime_error("Frame has an invalid value codec");
+            view.payloadSize = readVarint(in, end);
+            if (view.payloadSize != (size_t)(end - in))
+                throw std::runtime_error("Frame payload size does not match frame length");
+            view.payload = in;
+
+            unsigned wordBytes = valueTypeWordBytes(view.header.valueType);
+            bool consistent = codec == valueCodec::fpcOnly ? view.header.fpcSize == view.payloadSize
+                              : codec == valueCodec::raw   ? view.header.fpcSize == 0 && view.payloadSize % wordBytes == 0 &&
+                                                               view.header.elementCount == view.payloadSize / wordBytes
+                                                           : view.header.fpcSize == 0 && view.header.elementCount <= view.payloadSize * 8;
+            if (!consistent)
+                throw std::runtime_error("Frame payload does not match its value codec");
+            return;
+        }
+
+        bool split = view.header.flags & frameFlagSplitStreams;
+        if (split && (view.header.flags & frameFlagContextModel))
+            throw std::runtime_error("Frame sets both the context-model and split-stream flags");
+        if (split || (view.header.flags & frameFlagContextModel))
+            readContextTables(in, end, view.contextStats);
+        else
+            readFrequencyTable(in, end, 1u << frameScaleBits(view.header.flags), view.stats);
+
+        std::fill_n(view.streamSymbols, RANS::maxContexts, 0);
+        std::fill_n(view.streamBytes, RANS::maxContexts, 0);
+        uint64_t splitSymbols = 0, splitBytes = 0;
+        for (uint32_t context = 0; split && context < RANS::maxContexts; context++)
+        {
+            if (view.contextStats[context].commulativeFrequency[256] == 0)
+                continue;
+            view.streamSymbols[context] = readVarint(in, end);
+            view.streamBytes[context] = readVarint(in, end);
+            if (view.streamSymbols[context] > view.header.fpcSize || view.streamBytes[context] > size)
+                throw std::runtime_error("Split stream size in frame is out of range");
+            splitSymbols += view.streamSymbols[context];
+            splitBytes += view.streamBytes[context];
+        }
+        if (split && splitSymbols != view.header.fpcSize)
+            throw std::runtime_error("Split streams in frame do not add up to its FPC byte count");
+
+        view.payloadSize = readVarint(in, end);
+        if (view.payloadSize != (size_t)(end - in))
+            throw std::runtime_error("Frame payload size does not match frame length");
+        if (split && splitBytes != view.payloadSize)
+            throw std::runtime_error("Split streams in frame do not add up to its payload size");
+        view.payload = in;
+    }
+
+    static FrameContext &threadFrameContext()
+    {
+        static thread_local FrameContext context;
+        return context;
+    }
+
+    std::vector<uint8_t> encodeFrame(const std::vector<uint8_t> &fpc, uint64_t elementCount, uint8_t valueType, uint8_t flags,
+                                     uint8_t predictors, uint8_t tableBits)
+    {
+        std::vector<uint8_t> frame(frameBound(fpc.size()));
+        frame.resize(encodeFrame(fpc.data(), fpc.size(), elementCount, valueType, flags, predictors, tableBits, frame.data(), frame.size()));
+        frame.shrink_to_fit();
+        return frame;
+    }
+
+    size_t frameBound(size_t fpcSize)
+    {
+        // Fixed fields, three varints, the largest model (context tables of
+        // 2-byte varints and two size varints per split stream) and the CRC
+        // around the payload bound. Split streams add the fixed cost of each
+        // stream after the first to the payload.
+        const size_t largestModel = 2 + RANS::maxContexts * (32 + 256 * 2 + 2 * 10);
+        const size_t extraStreams = (RANS::maxContexts - 1) * RANS::interleavedBound(0, RANS::maxInterleave);
+        return 4 + 5 + 3 * 10 + largestModel + RANS::interleavedBound(fpcSize, RANS::maxInterleave) + extraStreams + 4;
+    }
+
+    size_t plainFrameBound(size_t payloadSize)
+    {
+        return 4 + 5 + 3 * 10 + payloadSize + 4;
+    }
+
+    size_t encodeFrame(const uint8_t *fpc, size_t fpcSize, uint64_t elementCount, uint8_t valueType, uint8_t flags,
+                       uint8_t predictors, uint8_t tableBits, uint8_t *output, size_t capacity)
+    {
+        return threadFrameContext().encode(fpc, fpcSize, elementCount, valueType, flags, predictors, tableBits, output, capacity);
+    }
+
+    std::vector<uint8_t> decodeFrameFpc(const frameView &view)
+    {
+        std::vector<uint8_t> fpc(view.header.fpcSize);
+        threadFrameContext().decodeFpc(view, fpc.data());
+        return fpc;
+    }
+
+    FrameContext::FrameContext() = default;
+    FrameContext::~FrameContext() = default;
+
+    size_t FrameContext::encode(const uint8_t *fpc, size_t fpcSize, uint64_t elementCount, uint8_t valueType, uint8_t flags,
+                                uint8_t predictors, uint8_t tableBits, uint8_t *output, size_t capacity)
+    {
+        if (capacity < frameBound(fpcSize))
+            throw std::invalid_argument("Frame output buffer is smaller than frameBound()");
+
+        frameHeader header;
+        header.flags = flags;
+        header.valueType = valueType;
+        header.predictors = predictors;
+        header.tableBits = tableBits;
+        header.elementCount = elementCount;
+        header.fpcSize = fpcSize;
+
+        // The payload is coded into the end of the buffer, then moved up behind
+        // the head once its size varint is known. The bound keeps the two apart.
+        head.clear();
+        size_t payloadSize;
+        if (flags & frameFlagSplitStreams)
+        {
+            payloadSize = encodeSplit(fpc, fpcSize, header, output, capacity);
+        }
+        else if (flags & frameFlagContextModel)
+        {
+            unsigned wordBytes = valueTypeWordBytes(valueType);
+            bool paired = pairedTags(predictorSetFromCode(predictors));
+            if (contextCoder)
+                contextCoder->reset(fpc, fpcSize, wordBytes, paired);
+            else
+                contextCoder = std::make_unique<RANS::ContextRANS>(fpc, fpcSize, wordBytes, paired);
+            writeFrameHead(head, header, [&](std::vector<uint8_t> &out) { writeContextTables(out, contextCoder->contextStats()); });
+            payloadSize = contextCoder->encodeInterleaved(output, capacity, RANS::defaultInterleave);
+        }
+        else
+        {
+            if (encoder)
+                encoder->reset(fpc, fpcSize, frameScaleBits(flags));
+            else
+                encoder = std::make_unique<RANS::RANS>(fpc, fpcSize, frameScaleBits(flags));
+            writeFrameHead(head, header, [&](std::vector<uint8_t> &out) { writeFrequencyTable(out, encoder->symbolStats()); });
+            payloadSize = encoder->encodeInterleaved(output, capacity, RANS::defaultInterleave);
+        }
+        writeVarint(head, payloadSize);
+
+        std::copy(head.begin(), head.end(), output);
+        std::memmove(output + head.size(), output + capacity - payloadSize, payloadSize);
+        size_t size = head.size() + payloadSize;
+        appendCrc(output, size);
+        return size + 4;
+    }
+
+    size_t FrameContext::encodePlain(const frameHeader &header, const uint8_t *payload, size_t payloadSize, uint8_t *output,
+                                     size_t capacity)
+    {
+        if (capacity < plainFrameBound(payloadSize))
+            throw std::invalid_argument("Frame output buffer is smaller than plainFrameBound()");
+
+        head.clear();
+        writeFrameHead(head, header, [](std::vector<uint8_t> &) {});
+        writeVarint(head, payloadSize);
+
+        std::copy(head.begin(), head.end(), output);
+        // An empty payload may come with null pointers, which memcpy must not see.
+        if (payloadSize > 0)
+            std::memcpy(output + head.size(), payload, payloadSize);
+        size_t size = head.size() + payloadSize;
+        appendCrc(output, size);
+        return size + 4;
+    }
+
+    const frameView &FrameContext::parse(const uint8_t *frame, size_t size)
+    {
+        parseFrame(frame, size, view);
+        return view;
+    }
+
+    void FrameContext::decodeFpc(const frameView &view, uint8_t *output)
+    {
+        switch (frameValueCodec(view.header.flags))
+        {
+        case valueCodec::fpcOnly:
+            if (view.payloadSize > 0)
+                std::memcpy(output, view.payload, view.payloadSize);
+            return;
+        case valueCodec::fpcEntropy:
+            break;
+        default:
+            throw std::runtime_error("Frame holds no FPC stream");
+        }
+        if (view.header.flags & frameFlagSplitStreams)
+        {
+            decodeSplit(view, output);
+            return;
+        }
+        if (view.header.flags & frameFlagContextModel)
+        {
+            unsigned wordBytes = valueTypeWordBytes(view.header.valueType);
+            bool paired = pairedTags(predictorSetFromCode(view.header.predictors));
+            if (contextCoder)
+                contextCoder->reset(view.contextStats, wordBytes, paired);
+            else
+                contextCoder = std::make_unique<RANS::ContextRANS>(view.contextStats, wordBytes, paired);
+            contextCoder->decodeInterleaved(view.payload, view.payloadSize, output, view.header.fpcSize);
+            return;
+        }
+
+        RANS::RANS &decoder = decoderFor(view.stats, frameScaleBits(view.header.flags));
+        decoder.decodeInterleaved(view.payload, view.payloadSize, output, view.header.fpcSize);
+    }
+
+    RANS::RANS &FrameContext::decoderFor(const RANS::SymbolStats &stats, uint32_t scaleBits)
+    {
+        constexpr size_t cachedDecoders = 4;
+        for (size_t i = 0; i < decoders.size(); i++)
+        {
+            if (decoders[i].scaleBits == scaleBits && decoders[i].table == stats.commulativeFrequency)
+            {
+                std::rotate(decoders.begin(), decoders.begin() + i, decoders.begin() + i + 1);
+                return *decoders.front().decoder;
+            }
+        }
+
+        // A full cache recycles its least recent decoder and that decoder's tables.
+        if (decoders.size() < cachedDecoders)
+            decoders.push_back(cachedDecoder{scaleBits, {}, std::make_unique<RANS::RANS>(stats, scaleBits)});
+        else
+            decoders.back().decoder->reset(stats, scaleBits);
+        decoders.back().scaleBits = scaleBits;
+        decoders.back().table = stats.commulativeFrequency;
+        std::rotate(decoders.begin(), decoders.end() - 1, decoders.end());
+        return *decoders.front().decoder;
+    }
+
+    size_t FrameContext::encodeSplit(const uint8_t *fpc, size_t fpcSize, const frameHeader &header, uint8_t *output, size_t capacity)
+    {
+        RANS::splitContextStreams(fpc, fpcSize, valueTypeWordBytes(header.valueType), pairedTags(predictorSetFromCode(header.predictors)),
+                                  streams);
+        streamStats.resize(RANS::maxContexts);
+        uint64_t coded[RANS::maxContexts] = {};
+
+        // Coded last to first, each one ending where the one after it starts,
+        // so the payload comes out in context order.
+        size_t payloadSize = 0;
+        for (uint32_t context = RANS::maxContexts; context-- > 0;)
+        {
+            const std::vector<uint8_t> &stream = streams[context];
+            if (stream.empty())
+            {
+                std::fill(streamStats[context].commulativeFrequency.begin(), streamStats[context].commulativeFrequency.end(), 0);
+                continue;
+            }
+            if (streamCoder)
+                streamCoder->reset(stream.data(), stream.size(), RANS::context_prob_bits);
+            else
+                streamCoder = std::make_unique<RANS::RANS>(stream.data(), stream.size(), RANS::context_prob_bits);
+            streamStats[context] = streamCoder->symbolStats();
+            coded[context] = streamCoder->encodeInterleaved(output, capacity - payloadSize, RANS::defaultInterleave);
+            payloadSize += coded[context];
+        }
+
+        writeFrameHead(head, header, [&](std::vector<uint8_t> &out) {
+            writeContextTables(out, streamStats);
+            for (uint32_t context = 0; context < RANS::maxContexts; context++)
+            {
+                if (!streams[context].empty())
+                {
+                    writeVarint(out, streams[context].size());
+                    writeVarint(out, coded[context]);
+                }
+            }
+        });
+        return payloadSize;
+    }
+
+    void FrameContext::decodeSplit(const frameView &view, uint8_t *output)
+    {
+        streams.resize(RANS::maxContexts);
+        const uint8_t *payload = view.payload;
+        // Reserved as by splitContextStreams(): a context holds at most one byte per value.
+        size_t values = (size_t)std::min(view.header.elementCount, view.header.fpcSize);
+        for (uint32_t context = 0; context < RANS::maxContexts; context++)
+        {
+            std::vector<uint8_t> &stream = streams[context];
+            stream.reserve(values);
+            stream.resize(view.streamSymbols[context]);
+            if (stream.empty())
+                continue;
+            if (streamCoder)
+                streamCoder->reset(view.contextStats[context], RANS::context_prob_bits);
+            else
+                streamCoder = std::make_unique<RANS::RANS>(view.contextStats[context], RANS::context_prob_bits);
+            streamCoder->decodeInterleaved(payload, view.streamBytes[context], stream.data(), stream.size());
+            payload += view.streamBytes[context];
+        }
+        RANS::mergeContextStreams(streams, valueTypeWordBytes(view.header.valueType), pairedTags(predictorSetFromCode(view.header.predictors)),
+                                  output, view.header.fpcSize);
+    }
+}
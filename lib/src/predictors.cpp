@@ -0,0 +1,75 @@
+#include "predictors.hpp"
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+namespace compression
+{
+    namespace
+    {
+        // Free arenas by size. Capped so a burst of coders does not pin its
+        // peak memory for the life of the process.
+        constexpr size_t maxPooledBytes = 64u << 20;
+
+        struct arenaPool
+        {
+            std::mutex lock;
+            std::multimap<size_t, predictorArena *> free;
+            size_t pooledBytes = 0;
+        };
+
+        // Never destroyed, so coders that outlive static destruction can still return their arenas.
+        arenaPool &pool()
+        {
+            static arenaPool *instance = new arenaPool;
+            return *instance;
+        }
+    }
+
+    predictorArena::predictorArena(size_t bytes) : memory(new uint64_t[(bytes + 7) / 8]()), words((bytes + 7) / 8)
+    {
+    }
+
+    predictorArena::handle predictorArena::acquire(size_t bytes)
+    {
+        size_t words = (bytes + 7) / 8;
+        arenaPool &arenas = pool();
+        {
+            std::lock_guard<std::mutex> guard(arenas.lock);
+            auto found = arenas.free.find(words * 8);
+            if (found != arenas.free.end())
+            {
+                predictorArena *arena = found->second;
+                arenas.free.erase(found);
+                arenas.pooledBytes -= words * 8;
+                arena->used = 0;
+                return handle(arena);
+            }
+        }
+        return handle(new predictorArena(bytes));
+    }
+
+    void predictorArena::releaser::operator()(predictorArena *arena) const
+    {
+        arenaPool &arenas = pool();
+        std::lock_guard<std::mutex> guard(arenas.lock);
+        size_t bytes = arena->words * 8;
+        if (arenas.pooledBytes + bytes > maxPooledBytes)
+        {
+            delete arena;
+            return;
+        }
+        arenas.free.emplace(bytes, arena);
+        arenas.pooledBytes += bytes;
+    }
+
+    void *predictorArena::carve(size_t bytes)
+    {
+        size_t words = (bytes + 7) / 8;
+        if (used + words > this->words)
+            throw std::logic_error("Predictor arena is too small for its tables");
+        void *slice = memory.get() + used;
+        used += words;
+        return slice;
+    }
+}
@@ -0,0 +1,218 @@
+#include "ransSimd.hpp"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RANS_X86_KERNELS 1
+#endif
+
+namespace RANS
+{
+    vector<uint32_t> populateDecodingSlots(const SymbolStats &stats, uint32_t prob_scale)
+    {
+        vector<uint32_t> slots;
+        populateDecodingSlots(stats, prob_scale, slots);
+        return slots;
+    }
+
+    void populateDecodingSlots(const SymbolStats &stats, uint32_t prob_scale, vector<uint32_t> &slots)
+    {
+        slots.resize(prob_scale);
+        for (int s = 0; s < 256; s++)
+        {
+            uint32_t start = stats.commulativeFrequency[s];
+            uint32_t end = stats.commulativeFrequency[s + 1];
+            for (uint32_t slot = start; slot < end; slot++)
+                slots[slot] = (end - start) | ((slot - start) << 16);
+        }
+    }
+
+#ifdef RANS_X86_KERNELS
+    // Lane j of a refill takes the k-th pending word, k = lanes below j that also refill.
+    struct refillTables
+    {
+        alignas(32) uint32_t avx2[256][8];
+        alignas(16) uint8_t sse41[16][16];
+
+        refillTables()
+        {
+            for (uint32_t m = 0; m < 256; m++)
+            {
+                uint32_t k = 0;
+                for (uint32_t lane = 0; lane < 8; lane++)
+                {
+                    avx2[m][lane] = (m >> lane) & 1 ? k++ : 0;
+                }
+            }
+            for (uint32_t m = 0; m < 16; m++)
+            {
+                uint32_t k = 0;
+                for (uint32_t lane = 0; lane < 4; lane++)
+                {
+                    bool refill = (m >> lane) & 1;
+                    sse41[m][lane * 4 + 0] = refill ? (uint8_t)(2 * k) : 0x80;
+                    sse41[m][lane * 4 + 1] = refill ? (uint8_t)(2 * k + 1) : 0x80;
+                    sse41[m][lane * 4 + 2] = 0x80;
+                    sse41[m][lane * 4 + 3] = 0x80;
+                    k += refill;
+                }
+            }
+        }
+    };
+
+    static const refillTables refill;
+
+    __attribute__((target("avx2"))) static size_t decodeGroupsAvx2(state *states, const uint8_t *&input, const uint8_t *inputEnd,
+                                                                   const uint32_t *slots, const uint8_t *symbols, uint8_t *output, size_t groups,
+                                                                   uint32_t scaleBits)
+    {
+        const __m256i slotMask = _mm256_set1_epi32((1u << scaleBits) - 1);
+        const __m128i scaleShift = _mm_cvtsi32_si128((int)scaleBits);
+        const __m256i lowHalf = _mm256_set1_epi32(0xffff);
+        const __m256i byteMask = _mm256_set1_epi32(0xff);
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i packBytes = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                                   0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+
+        __m256i x = _mm256_loadu_si256((const __m256i *)states);
+        const uint8_t *in = input;
+        size_t g = 0;
+
+        for (; g < groups && inputEnd - in >= 16; g++)
+        {
+            __m256i slot = _mm256_and_si256(x, slotMask);
+            __m256i entry = _mm256_i32gather_epi32((const int *)slots, slot, 4);
+            __m256i symbol = _mm256_and_si256(_mm256_i32gather_epi32((const int *)symbols, slot, 1), byteMask);
+
+            __m256i frequency = _mm256_and_si256(entry, lowHalf);
+            __m256i bias = _mm256_srli_epi32(entry, 16);
+            x = _mm256_add_epi32(_mm256_mullo_epi32(frequency, _mm256_srl_epi32(x, scaleShift)), bias);
+
+            __m256i packed = _mm256_shuffle_epi8(symbol, packBytes);
+            uint32_t low = (uint32_t)_mm256_extract_epi32(packed, 0);
+            uint32_t high = (uint32_t)_mm256_extract_epi32(packed, 4);
+            memcpy(output + g * 8, &low, 4);
+            memcpy(output + g * 8 + 4, &high, 4);
+
+            // Branchless refill: lanes below wordLowerBound pull the next words in lane order.
+            __m256i needsRefill = _mm256_cmpeq_epi32(_mm256_srli_epi32(x, 16), zero);
+            uint32_t laneMask = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(needsRefill));
+            __m256i words = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)in));
+            words = _mm256_permutevar8x32_epi32(words, _mm256_load_si256((const __m256i *)refill.avx2[laneMask]));
+            x = _mm256_blendv_epi8(x, _mm256_or_si256(_mm256_slli_epi32(x, 16), words), needsRefill);
+            in += 2 * __builtin_popcount(laneMask);
+        }
+
+        _mm256_storeu_si256((__m256i *)states, x);
+        input = in;
+        return g;
+    }
+
+    __attribute__((target("sse4.1"))) static inline __m128i decodeLanesSse41(__m128i x, const uint8_t *&in, const uint32_t *slots,
+                                                                            const uint8_t *symbols, uint8_t *output, uint32_t scaleBits)
+    {
+        alignas(16) uint32_t slot[4];
+        _mm_store_si128((__m128i *)slot, _mm_and_si128(x, _mm_set1_epi32((1u << scaleBits) - 1)));
+
+        __m128i entry = _mm_setr_epi32(slots[slot[0]], slots[slot[1]], slots[slot[2]], slots[slot[3]]);
+        for (int lane = 0; lane < 4; lane++)
+            output[lane] = symbols[slot[lane]];
+
+        __m128i frequency = _mm_and_si128(entry, _mm_set1_epi32(0xffff));
+        __m128i bias = _mm_srli_epi32(entry, 16);
+        x = _mm_add_epi32(_mm_mullo_epi32(frequency, _mm_srl_epi32(x, _mm_cvtsi32_si128((int)scaleBits))), bias);
+
+        __m128i needsRefill = _mm_cmpeq_epi32(_mm_srli_epi32(x, 16), _mm_setzero_si128());
+        uint32_t laneMask = (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(needsRefill));
+        __m128i words = _mm_shuffle_epi8(_mm_loadl_epi64((const __m128i *)in), _mm_load_si128((const __m128i *)refill.sse41[laneMask]));
+        x = _mm_blendv_epi8(x, _mm_or_si128(_mm_slli_epi32(x, 16), words), needsRefill);
+        in += 2 * __builtin_popcount(laneMask);
+        return x;
+    }
+
+    __attribute__((target("sse4.1"))) static size_t decodeGroupsSse41(state *states, uint32_t ways, const uint8_t *&input, const uint8_t *inputEnd,
+                                                                      const uint32_t *slots, const uint8_t *symbols, uint8_t *output, size_t groups,
+                                                                      uint32_t scaleBits)
+    {
+        // Eight-way streams run as two four-lane halves; the low half refills
+        // first, which matches the scalar lane order.
+        __m128i low = _mm_loadu_si128((const __m128i *)states);
+        __m128i high = ways == 8 ? _mm_loadu_si128((const __m128i *)(states + 4)) : _mm_setzero_si128();
+        const uint8_t *in = input;
+        size_t g = 0;
+
+        for (; g < groups && inputEnd - in >= 16; g++)
+        {
+            low = decodeLanesSse41(low, in, slots, symbols, output + g * ways, scaleBits);
+            if (ways == 8)
+                high = decodeLanesSse41(high, in, slots, symbols, output + g * ways + 4, scaleBits);
+        }
+
+        _mm_storeu_si128((__m128i *)states, low);
+        if (ways == 8)
+            _mm_storeu_si128((__m128i *)(states + 4), high);
+        input = in;
+        return g;
+    }
+
+    static decodeKernel detectDecodeKernel()
+    {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return decodeKernel::avx2;
+        if (__builtin_cpu_supports("sse4.1"))
+            return decodeKernel::sse41;
+        return decodeKernel::scalar;
+    }
+#else
+    static decodeKernel detectDecodeKernel()
+    {
+        return decodeKernel::scalar;
+    }
+#endif
+
+    static const decodeKernel detectedKernel = detectDecodeKernel();
+    static decodeKernel selectedKernel = detectedKernel;
+
+    decodeKernel bestDecodeKernel()
+    {
+        return detectedKernel;
+    }
+
+    decodeKernel activeDecodeKernel()
+    {
+        return selectedKernel;
+    }
+
+    void setDecodeKernel(decodeKernel kernel)
+    {
+        selectedKernel = kernel <= detectedKernel ? kernel : detectedKernel;
+    }
+
+    const char *decodeKernelName(decodeKernel kernel)
+    {
+        switch (kernel)
+        {
+        case decodeKernel::avx2:
+            return "avx2";
+        case decodeKernel::sse41:
+            return "sse4.1";
+        default:
+            return "scalar";
+        }
+    }
+
+    size_t decodeInterleavedSimd(state *states, uint32_t ways, const uint8_t *&input, const uint8_t *inputEnd,
+                                 const uint32_t *slots, const uint8_t *symbols, uint8_t *output, size_t symbolCount,
+                                 uint32_t scaleBits)
+    {
+#ifdef RANS_X86_KERNELS
+        size_t groups = symbolCount / ways;
+        if (selectedKernel == decodeKernel::avx2 && ways == 8)
+            return decodeGroupsAvx2(states, input, inputEnd, slots, symbols, output, groups, scaleBits) * ways;
+        if (selectedKernel != decodeKernel::scalar && (ways == 4 || ways == 8))
+            return decodeGroupsSse41(states, ways, input, inputEnd, slots, symbols, output, groups, scaleBits) * ways;
+#endif
+        return 0;
+    }
+}
@@ -0,0 +1,712 @@
+#include "seriesStore.hpp"
+#include "frameFormat.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace compression
+{
+    static const char *manifestName = "MANIFEST";
+    static const char *logName = "MANIFEST.log";
+    static const char *segmentSuffix = ".seg";
+    // The log is folded into the manifest once it is larger than both.
+    static const uint64_t minLogRewrite = 1 << 16;
+
+    [[noreturn]] static void throwIoError(const std::string &what, const std::string &path)
+    {
+        throw std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+    }
+
+    // Owns a descriptor so every early exit closes it.
+    struct fileDescriptor
+    {
+        int fd;
+        fileDescriptor(const std::string &path, int flags) : fd(open(path.c_str(), flags, 0644))
+        {
+            if (fd < 0)
+                throwIoError("Could not open", path);
+        }
+        ~fileDescriptor() { close(fd); }
+    };
+
+    static void writeAt(const fileDescriptor &file, const uint8_t *data, size_t size, uint64_t offset, const std::string &path)
+    {
+        while (size > 0)
+        {
+            ssize_t written = pwrite(file.fd, data, size, (off_t)offset);
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written <= 0)
+                throwIoError("Could not write", path);
+            data += written;
+            size -= written;
+            offset += written;
+        }
+    }
+
+    static void syncFile(const fileDescriptor &file, const std::string &path)
+    {
+        if (fsync(file.fd) != 0)
+            throwIoError("Could not sync", path);
+    }
+
+    static bool validSeriesName(const std::string &name)
+    {
+        if (name.empty() || name.size() > 64 || name[0] == '.')
+            return false;
+        return std::all_of(name.begin(), name.end(), [](char c) {
+            return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_' || c == '.' || c == '-';
+        });
+    }
+
+    template <typename T>
+    struct SeriesStore<T>::mappedSegment
+    {
+        const uint8_t *data = nullptr;
+        size_t size = 0;
+
+        explicit mappedSegment(const std::string &path)
+        {
+            fileDescriptor file(path, O_RDONLY);
+            struct stat info;
+            if (fstat(file.fd, &info) != 0)
+                throwIoError("Could not stat", path);
+            size = info.st_size;
+            if (size > 0)
+            {
+                void *mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, file.fd, 0);
+                if (mapping == MAP_FAILED)
+                    throwIoError("Could not map", path);
+                data = static_cast<const uint8_t *>(mapping);
+            }
+        }
+
+        ~mappedSegment()
+        {
+            if (data)
+                munmap(const_cast<uint8_t *>(data), size);
+        }
+    };
+
+    template <typename T>
+    SeriesStore<T>::SeriesStore(const std::string &directory) : directory(directory)
+    {
+        std::filesystem::create_directories(directory);
+        loadManifest();
+        loadLog();
+
+        // Drop what a crash left behind: segments of other generations from an
+        // unfinished compaction, and the tail of an unfinished append.
+        for (const auto &entry : std::filesystem::directory_iterator(directory))
+        {
+            if (entry.path().extension() != segmentSuffix)
+                continue;
+            std::string stem = entry.path().stem().string();
+            size_t dot = stem.rfind('.');
+            auto it = dot == std::string::npos ? series.end() : series.find(stem.substr(0, dot));
+            if (it == series.end() || stem.substr(dot + 1) != std::to_string(it->second.generation))
+                std::filesystem::remove(entry.path());
+        }
+        for (const auto &[name, state] : series)
+        {
+            std::string path = segmentPath(name, state.generation);
+            if (!std::filesystem::exists(path) || std::filesystem::file_size(path) < state.index.offset.back())
+                throw std::runtime_error("Segment " + path + " is shorter than the manifest records");
+            std::filesystem::resize_file(path, state.index.offset.back());
+        }
+    }
+
+    template <typename T>
+    SeriesStore<T>::~SeriesStore()
+    {
+        try
+        {
+            stopCompaction();
+        }
+        catch (const std::exception &)
+        {
+        }
+    }
+
+    template <typename T>
+    void SeriesStore<T>::setEntropyBackend(entropyBackend backend)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        this->backend = backend;
+    }
+
+    template <typename T>
+    void SeriesStore<T>::setPredictorSet(predictorSet predictors)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        this->predictors = predictors;
+    }
+
+    template <typename T>
+    void SeriesStore<T>::setTableBits(unsigned tableBits)
+    {
+        if (tableBits < minTableBits || tableBits > maxTableBits)
+            throw std::invalid_argument("Predictor table bits must be between " + std::to_string(minTableBits) +
+                                        " and " + std::to_string(maxTableBits));
+        std::lock_guard<std::mutex> guard(lock);
+        this->tableBits = tableBits;
+    }
+
+    template <typename T>
+    void SeriesStore<T>::setCompactionTarget(size_t values)
+    {
+        if (values == 0)
+            throw std::invalid_argument("Compaction target must be positive");
+        std::lock_guard<std::mutex> guard(lock);
+        compactionTarget = values;
+    }
+
+    template <typename T>
+    std::string SeriesStore<T>::segmentPath(const std::string &name, uint64_t generation) const
+    {
+        return directory + "/" + name + "." + std::to_string(generation) + segmentSuffix;
+    }
+
+    // Callers hold `lock`, which guards the settings.
+    template <typename T>
+    std::unique_ptr<compressorDecompressor<T>> SeriesStore<T>::makeCodec() const
+    {
+        auto codec = std::make_unique<compressorDecompressor<T>>(predictors, tableBits);
+        codec->setEntropyBackend(backend);
+        return codec;
+    }
+
+    // Callers hold `appendLock`; `lock` is held only while the series are read.
+    template <typename T>
+    void SeriesStore<T>::writeManifest()
+    {
+        std::vector<uint8_t> manifest;
+        writeU32(manifest, manifestMagic);
+        manifest.push_back(manifestVersion);
+        manifest.push_back(valueTypeCode<T>::value);
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            writeVarint(manifest, series.size());
+            for (const auto &[name, state] : series)
+            {
+                writeVarint(manifest, name.size());
+                manifest.insert(manifest.end(), name.begin(), name.end());
+                writeVarint(manifest, state.generation);
+                writeVarint(manifest, state.index.blockCount());
+                for (size_t block = 0; block < state.index.blockCount(); block++)
+                {
+                    writeVarint(manifest, state.index.firstElement[block + 1] - state.index.firstElement[block]);
+                    writeVarint(manifest, state.index.offset[block + 1] - state.index.offset[block]);
+                }
+            }
+        }
+        writeU32(manifest, crc32(manifest.data(), manifest.size()));
+
+        std::string path = directory + "/" + manifestName;
+        std::string temporary = path + ".tmp";
+        {
+            fileDescriptor file(temporary, O_WRONLY | O_CREAT | O_TRUNC);
+            writeAt(file, manifest.data(), manifest.size(), 0, temporary);
+            syncFile(file, temporary);
+        }
+        if (rename(temporary.c_str(), path.c_str()) != 0)
+            throwIoError("Could not replace", path);
+        fileDescriptor parent(directory, O_RDONLY | O_DIRECTORY);
+        syncFile(parent, directory);
+        manifestSize = manifest.size();
+
+        // Every record in the log is in the manifest now. Should the log
+        // outlive a crash here, replay skips what it holds.
+        std::string logPath = directory + "/" + logName;
+        fileDescriptor log(logPath, O_WRONLY | O_CREAT);
+        if (ftruncate(log.fd, 0) != 0)
+            throwIoError("Could not truncate", logPath);
+        logSize = 0;
+    }
+
+    // Callers hold `appendLock`.
+    template <typename T>
+    void SeriesStore<T>::appendLog(const std::string &name, uint64_t generation, size_t block, uint64_t elements,
+                                   uint64_t frameSize)
+    {
+        std::vector<uint8_t> fields;
+        writeVarint(fields, name.size());
+        fields.insert(fields.end(), name.begin(), name.end());
+        writeVarint(fields, generation);
+        writeVarint(fields, block);
+        writeVarint(fields, elements);
+        writeVarint(fields, frameSize);
+
+        std::vector<uint8_t> record;
+        writeU32(record, (uint32_t)fields.size());
+        record.insert(record.end(), fields.begin(), fields.end());
+        writeU32(record, crc32(fields.data(), fields.size()));
+
+        std::string path = directory + "/" + logName;
+        fileDescriptor file(path, O_WRONLY | O_CREAT);
+        writeAt(file, record.data(), record.size(), logSize, path);
+        syncFile(file, path);
+        if (logSize == 0)
+        {
+            fileDescriptor parent(directory, O_RDONLY | O_DIRECTORY);
+            syncFile(parent, directory);
+        }
+        logSize += record.size();
+    }
+
+    template <typename T>
+    void SeriesStore<T>::loadManifest()
+    {
+        std::string path = directory + "/" + manifestName;
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return;
+        std::vector<uint8_t> manifest((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+        const size_t headerSize = 6;
+        if (manifest.size() < headerSize + 4 || readU32(manifest.data()) != manifestMagic)
+            throw std::runtime_error("Not a series store manifest: " + path);
+        if (manifest[4] != manifestVersion)
+            throw std::runtime_error("Unsupported series store manifest version: " + path);
+        if (readU32(manifest.data() + manifest.size() - 4) != crc32(manifest.data(), manifest.size() - 4))
+            throw std::runtime_error("Series store manifest checksum mismatch: " + path);
+        if (manifest[5] != valueTypeCode<T>::value)
+            throw std::runtime_error("Series store holds a different value type: " + directory);
+
+        const uint8_t *in = manifest.data() + headerSize;
+        const uint8_t *end = manifest.data() + manifest.size() - 4;
+        size_t seriesCount = readVarint(in, end);
+        for (size_t i = 0; i < seriesCount; i++)
+        {
+            uint64_t nameLength = readVarint(in, end);
+            if (nameLength > (uint64_t)(end - in))
+                throw std::runtime_error("Series store manifest is truncated: " + path);
+            std::string name(reinterpret_cast<const char *>(in), nameLength);
+            in += nameLength;
+            if (!validSeriesName(name) || series.count(name))
+                throw std::runtime_error("Series store manifest has a bad series name: " + path);
+
+            seriesState &state = series[name];
+            state.generation = readVarint(in, end);
+            size_t blockCount = readVarint(in, end);
+            if (blockCount > (size_t)(end - in))
+                throw std::runtime_error("Series store manifest is inconsistent: " + path);
+            state.index.firstElement.assign(1, 0);
+            state.index.offset.assign(1, 0);
+            for (size_t block = 0; block < blockCount; block++)
+            {
+                state.index.firstElement.push_back(state.index.firstElement.back() + readVarint(in, end));
+                state.index.offset.push_back(state.index.offset.back() + readVarint(in, end));
+            }
+        }
+        if (in != end)
+            throw std::runtime_error("Series store manifest does not match its length: " + path);
+        manifestSize = manifest.size();
+    }
+
+    template <typename T>
+    void SeriesStore<T>::loadLog()
+    {
+        std::string path = directory + "/" + logName;
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return;
+        std::vector<uint8_t> log((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        file.close();
+
+        // A record cut short or failing its checksum is an append that did not
+        // complete; it ends the log.
+        const uint8_t *record = log.data();
+        const uint8_t *end = log.data() + log.size();
+        while (end - record >= 8)
+        {
+            size_t size = readU32(record);
+            if (size > (size_t)(end - record) - 8 || readU32(record + 4 + size) != crc32(record + 4, size))
+                break;
+            const uint8_t *in = record + 4;
+            const uint8_t *fieldsEnd = in + size;
+            uint64_t nameLength = readVarint(in, fieldsEnd);
+            if (nameLength > (uint64_t)(fieldsEnd - in))
+                throw std::runtime_error("Series store log is inconsistent: " + path);
+            std::string name(reinterpret_cast<const char *>(in), nameLength);
+            in += nameLength;
+            uint64_t generation = readVarint(in, fieldsEnd);
+            uint64_t block = readVarint(in, fieldsEnd);
+            uint64_t elements = readVarint(in, fieldsEnd);
+            uint64_t frameSize = readVarint(in, fieldsEnd);
+            if (in != fieldsEnd)
+                throw std::runtime_error("Series store log is inconsistent: " + path);
+
+            auto it = series.find(name);
+            if (it == series.end())
+                throw std::runtime_error("Series store log names a series the manifest lacks: " + path);
+            seriesState &state = it->second;
+            bool covered = generation < state.generation || (generation == state.generation && block < state.index.blockCount());
+            if (!covered)
+            {
+                if (generation != state.generation || block != state.index.blockCount())
+                    throw std::runtime_error("Series store log does not follow its manifest: " + path);
+                state.index.firstElement.push_back(state.index.firstElement.back() + elements);
+                state.index.offset.push_back(state.index.offset.back() + frameSize);
+            }
+            record += size + 8;
+        }
+        logSize = record - log.data();
+        if (logSize < log.size())
+            std::filesystem::resize_file(path, logSize);
+    }
+
+    template <typename T>
+    const typename SeriesStore<T>::seriesState &SeriesStore<T>::find(const std::string &name) const
+    {
+        auto it = series.find(name);
+        if (it == series.end())
+            throw std::out_of_range("No series named " + name + " in " + directory);
+        return it->second;
+    }
+
+    // Callers hold `lock`. Appends only grow a segment, so a mapping that
+    // covers every committed block stays usable.
+    template <typename T>
+    std::shared_ptr<typename SeriesStore<T>::mappedSegment> SeriesStore<T>::mapSegment(const std::string &name,
+                                                                                      const seriesState &state) const
+    {
+        if (!state.mapping || state.mapping->size < state.index.offset.back())
+            state.mapping = std::make_shared<mappedSegment>(segmentPath(name, state.generation));
+        return state.mapping;
+    }
+
+    template <typename T>
+    void SeriesStore<T>::append(const std::string &name, const std::vector<T> &values)
+    {
+        if (!validSeriesName(name))
+            throw std::invalid_argument("Invalid series name: " + name);
+        if (values.empty())
+            return;
+
+        std::unique_ptr<compressorDecompressor<T>> codec;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            codec = makeCodec();
+        }
+        std::vector<uint8_t> frame = codec->compress(values);
+
+        // Appends take turns so each knows where its block lands. `lock` is
+        // held only to read that place and to publish the block, so readers
+        // never wait on the syncs below.
+        std::lock_guard<std::mutex> appending(appendLock);
+        bool created;
+        uint64_t generation = 0, offset = 0;
+        size_t block = 0;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            auto it = series.find(name);
+            created = it == series.end();
+            if (!created)
+            {
+                generation = it->second.generation;
+                offset = it->second.index.offset.back();
+                block = it->second.index.blockCount();
+            }
+        }
+
+        // Until the log or the manifest records it, a frame in the segment is
+        // not part of the series and the next append overwrites it.
+        std::string path = segmentPath(name, generation);
+        {
+            fileDescriptor file(path, O_WRONLY | O_CREAT);
+            writeAt(file, frame.data(), frame.size(), offset, path);
+            syncFile(file, path);
+        }
+        if (!created)
+            appendLog(name, generation, block, values.size(), frame.size());
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            seriesState &state = series[name];
+            if (created)
+            {
+                state.index.firstElement.assign(1, 0);
+                state.index.offset.assign(1, 0);
+            }
+            state.index.firstElement.push_back(state.index.firstElement.back() + values.size());
+            state.index.offset.push_back(state.index.offset.back() + frame.size());
+        }
+
+        // A new series is only recorded by the manifest. Otherwise the block
+        // is already durable in the log, and a failed rewrite is left to the
+        // next append.
+        if (created)
+        {
+            try
+            {
+                writeManifest();
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                series.erase(name);
+                throw;
+            }
+        }
+        else if (logSize > std::max(manifestSize, minLogRewrite))
+        {
+            try
+            {
+                writeManifest();
+            }
+            catch (const std::exception &)
+            {
+            }
+        }
+    }
+
+    template <typename T>
+    std::vector<std::string> SeriesStore<T>::seriesNames() const
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        std::vector<std::string> names;
+        for (const auto &entry : series)
+            names.push_back(entry.first);
+        return names;
+    }
+
+    template <typename T>
+    uint64_t SeriesStore<T>::elementCount(const std::string &name) const
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return find(name).index.elementCount();
+    }
+
+    template <typename T>
+    size_t SeriesStore<T>::blockCount(const std::string &name) const
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return find(name).index.blockCount();
+    }
+
+    template <typename T>
+    std::vector<T> SeriesStore<T>::read(const std::string &name) const
+    {
+        return readRange(name, 0, elementCount(name));
+    }
+
+    template <typename T>
+    std::vector<T> SeriesStore<T>::readRange(const std::string &name, uint64_t begin, uint64_t end) const
+    {
+        blockIndex index;
+        std::shared_ptr<mappedSegment> mapping;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            const seriesState &state = find(name);
+            index = state.index;
+            if (begin > end || end > index.elementCount())
+                throw std::out_of_range("Element range is outside series " + name);
+            if (begin < end)
+                mapping = mapSegment(name, state);
+        }
+
+        std::vector<T> output(end - begin);
+        if (begin == end)
+            return output;
+
+        compressorDecompressor<T> codec;
+        for (size_t block = index.blockOf(begin); block <= index.blockOf(end - 1); block++)
+        {
+            std::vector<T> values = codec.decompress(mapping->data + index.offset[block], index.offset[block + 1] - index.offset[block]);
+            if (values.size() != index.firstElement[block + 1] - index.firstElement[block])
+                throw std::runtime_error("Block of series " + name + " decoded to an unexpected length");
+
+            uint64_t from = std::max(begin, index.firstElement[block]);
+            uint64_t to = std::min(end, index.firstElement[block + 1]);
+            std::copy(values.begin() + (from - index.firstElement[block]), values.begin() + (to - index.firstElement[block]),
+                      output.begin() + (from - begin));
+        }
+        return output;
+    }
+
+    template <typename T>
+    size_t SeriesStore<T>::compact()
+    {
+        std::lock_guard<std::mutex> compacting(compactionLock);
+        size_t removed = 0;
+        for (const auto &name : seriesNames())
+            removed += compactSeries(name);
+        return removed;
+    }
+
+    // Callers hold `compactionLock`, so the generation cannot change under it;
+    // appends can, and the blocks they add meanwhile are copied over at the
+    // end, with appends held off by `appendLock`.
+    template <typename T>
+    size_t SeriesStore<T>::compactSeries(const std::string &name)
+    {
+        blockIndex index;
+        uint64_t generation;
+        size_t target;
+        std::shared_ptr<mappedSegment> mapping;
+        std::unique_ptr<compressorDecompressor<T>> encoder;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            const seriesState &state = find(name);
+            index = state.index;
+            generation = state.generation;
+            target = compactionTarget;
+            encoder = makeCodec();
+        }
+
+        // Greedy runs of consecutive blocks holding at most `target` values in
+        // total; a block at or above the target stands alone.
+        std::vector<size_t> runStart;
+        for (size_t block = 0; block < index.blockCount();)
+        {
+            runStart.push_back(block);
+            uint64_t values = index.firstElement[block + 1] - index.firstElement[block];
+            for (block++; block < index.blockCount(); block++)
+            {
+                uint64_t next = index.firstElement[block + 1] - index.firstElement[block];
+                if (values + next > target)
+                    break;
+                values += next;
+            }
+        }
+        if (runStart.size() == index.blockCount())
+            return 0;
+        runStart.push_back(index.blockCount());
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            mapping = mapSegment(name, find(name));
+        }
+
+        std::string path = segmentPath(name, generation + 1);
+        fileDescriptor file(path, O_WRONLY | O_CREAT | O_TRUNC);
+        blockIndex compacted;
+        compacted.firstElement.assign(1, 0);
+        compacted.offset.assign(1, 0);
+        auto writeBlock = [&](const uint8_t *frame, size_t size, uint64_t elements) {
+            writeAt(file, frame, size, compacted.offset.back(), path);
+            compacted.firstElement.push_back(compacted.firstElement.back() + elements);
+            compacted.offset.push_back(compacted.offset.back() + size);
+        };
+
+        compressorDecompressor<T> decoder;
+        for (size_t run = 0; run + 1 < runStart.size(); run++)
+        {
+            size_t first = runStart[run], last = runStart[run + 1];
+            if (last - first == 1)
+            {
+                writeBlock(mapping->data + index.offset[first], index.offset[last] - index.offset[first],
+                           index.firstElement[last] - index.firstElement[first]);
+                continue;
+            }
+
+            std::vector<T> merged;
+            merged.reserve(index.firstElement[last] - index.firstElement[first]);
+            for (size_t block = first; block < last; block++)
+            {
+                std::vector<T> values = decoder.decompress(mapping->data + index.offset[block], index.offset[block + 1] - index.offset[block]);
+                merged.insert(merged.end(), values.begin(), values.end());
+            }
+            if (merged.size() != index.firstElement[last] - index.firstElement[first])
+                throw std::runtime_error("Blocks of series " + name + " decoded to an unexpected length");
+            std::vector<uint8_t> frame = encoder->compress(merged);
+            writeBlock(frame.data(), frame.size(), merged.size());
+        }
+
+        std::lock_guard<std::mutex> appending(appendLock);
+        blockIndex current;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            const seriesState &state = series.at(name);
+            current = state.index;
+            if (current.blockCount() > index.blockCount())
+                mapping = mapSegment(name, state);
+        }
+        for (size_t block = index.blockCount(); block < current.blockCount(); block++)
+            writeBlock(mapping->data + current.offset[block], current.offset[block + 1] - current.offset[block],
+                       current.firstElement[block + 1] - current.firstElement[block]);
+        syncFile(file, path);
+
+        seriesState previous;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            seriesState &state = series.at(name);
+            previous = state;
+            state.generation = generation + 1;
+            state.index = compacted;
+            state.mapping.reset();
+        }
+        try
+        {
+            writeManifest();
+        }
+        catch (...)
+        {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                series.at(name) = previous;
+            }
+            std::filesystem::remove(path);
+            throw;
+        }
+        // Readers still holding the old mapping keep reading it after the unlink.
+        std::filesystem::remove(segmentPath(name, generation));
+        return previous.index.blockCount() - compacted.blockCount();
+    }
+
+    template <typename T>
+    void SeriesStore<T>::startCompaction(std::chrono::milliseconds interval)
+    {
+        if (compactionThread.joinable())
+            throw std::logic_error("Background compaction is already running");
+        stopping = false;
+        compactionError = nullptr;
+        compactionThread = std::thread([this, interval] {
+            std::unique_lock<std::mutex> wakeGuard(compactionWakeLock);
+            while (!compactionWake.wait_for(wakeGuard, interval, [this] { return stopping; }))
+            {
+                wakeGuard.unlock();
+                try
+                {
+                    compact();
+                }
+                catch (...)
+                {
+                    wakeGuard.lock();
+                    compactionError = std::current_exception();
+                    return;
+                }
+                wakeGuard.lock();
+            }
+        });
+    }
+
+    template <typename T>
+    void SeriesStore<T>::stopCompaction()
+    {
+        if (!compactionThread.joinable())
+            return;
+        {
+            std::lock_guard<std::mutex> wakeGuard(compactionWakeLock);
+            stopping = true;
+        }
+        compactionWake.notify_all();
+        compactionThread.join();
+        if (compactionError)
+            std::rethrow_exception(std::exchange(compactionError, nullptr));
+    }
+
+    template class SeriesStore<float>;
+    template class SeriesStore<double>;
+    template class SeriesStore<uint32_t>;
+    template class SeriesStore<uint64_t>;
+}
@@ -0,0 +1,190 @@
+#include "streamCodec.hpp"
+#include "frameFormat.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace compression
+{
+    template <typename T>
+    StreamCompressor<T>::StreamCompressor(sink output, size_t chunkValues)
+        : output(std::move(output)), chunkValues(std::max<size_t>(chunkValues, 1)),
+          codec(std::make_unique<compressorDecompressor<T>>()), frames(std::make_unique<FrameContext>())
+    {
+        pending.reserve(this->chunkValues);
+    }
+
+    template <typename T>
+    StreamCompressor<T>::~StreamCompressor() = default;
+
+    template <typename T>
+    void StreamCompressor<T>::setPredictorSet(predictorSet predictors)
+    {
+        if (started && predictors != codec->getPredictorSet())
+            throw std::logic_error("Predictor set of a StreamCompressor changed after its first chunk");
+        codec->setPredictorSet(predictors);
+    }
+
+    template <typename T>
+    void StreamCompressor<T>::setTableBits(unsigned tableBits)
+    {
+        if (started && tableBits != codec->getTableBits())
+            throw std::logic_error("Table bits of a StreamCompressor changed after its first chunk");
+        codec->setTableBits(tableBits);
+    }
+
+    template <typename T>
+    void StreamCompressor<T>::push(const T *values, size_t count)
+    {
+        if (finished)
+            throw std::logic_error("push() after finish() on a StreamCompressor");
+
+        while (count > 0)
+        {
+            size_t take = std::min(count, chunkValues - pending.size());
+            pending.insert(pending.end(), values, values + take);
+            values += take;
+            count -= take;
+
+            if (pending.size() == chunkValues)
+                emitChunk();
+        }
+    }
+
+    template <typename T>
+    void StreamCompressor<T>::finish()
+    {
+        if (finished)
+            return;
+        if (!pending.empty())
+            emitChunk();
+        finished = true;
+    }
+
+    template <typename T>
+    void StreamCompressor<T>::emitChunk()
+    {
+        fpc.resize(compressorDecompressor<T>::fpcBound(pending.size()));
+        size_t fpcSize = codec->encodeValues(pending.data(), pending.size(), fpc.data());
+
+        // The frame goes after room for the longest size varint, which is then
+        // written right before it so the chunk leaves in one piece.
+        constexpr size_t prefixRoom = 10;
+        uint8_t flags = (started ? frameFlagContinued : 0) | entropyFrameFlags(backend);
+        chunk.resize(prefixRoom + frameBound(fpcSize));
+        size_t frameSize = frames->encode(fpc.data(), fpcSize, pending.size(), valueTypeCode<T>::value, flags,
+                                          (uint8_t)codec->getPredictorSet(), (uint8_t)codec->getTableBits(),
+                                          chunk.data() + prefixRoom, chunk.size() - prefixRoom);
+        started = true;
+        pending.clear();
+
+        uint8_t prefix[prefixRoom];
+        size_t prefixSize = 0;
+        for (uint64_t value = frameSize; ; value >>= 7)
+        {
+            prefix[prefixSize++] = (uint8_t)(value & 0x7f) | (value >= 0x80 ? 0x80 : 0);
+            if (value < 0x80)
+                break;
+        }
+        uint8_t *start = chunk.data() + prefixRoom - prefixSize;
+        std::copy(prefix, prefix + prefixSize, start);
+        output(start, prefixSize + frameSize);
+    }
+
+    template <typename T>
+    StreamDecompressor<T>::StreamDecompressor(source input, size_t maxChunkValues)
+        : input(std::move(input)), maxChunkValues(std::max<size_t>(maxChunkValues, 1)),
+          codec(std::make_unique<compressorDecompressor<T>>())
+    {
+    }
+
+    template <typename T>
+    bool StreamDecompressor<T>::readExact(uint8_t *data, size_t size)
+    {
+        while (size > 0)
+        {
+            size_t got = input(data, size);
+            if (got == 0)
+                return false;
+            data += got;
+            size -= got;
+        }
+        return true;
+    }
+
+    template <typename T>
+    bool StreamDecompressor<T>::nextChunk()
+    {
+        uint8_t envelope[10];
+        size_t length = 0;
+        do
+        {
+            if (!readExact(&envelope[length], 1))
+            {
+                if (length == 0)
+                    return false;
+                throw std::runtime_error("Stream ends inside a chunk header");
+            }
+        } while ((envelope[length++] & 0x80) && length < sizeof(envelope));
+
+        const uint8_t *cursor = envelope;
+        uint64_t frameSize = readVarint(cursor, envelope + length);
+        if (frameSize > frameBound(compressorDecompressor<T>::fpcBound(maxChunkValues)))
+            throw std::runtime_error("Stream chunk is larger than the chunk size allows");
+
+        frame.resize(frameSize);
+        if (!readExact(frame.data(), frameSize))
+            throw std::runtime_error("Stream ends inside a chunk");
+
+        frameView view = parseFrame(frame.data(), frame.size());
+        if (view.header.valueType != valueTypeCode<T>::value)
+            throw std::runtime_error("Stream chunk holds a different value type");
+        if (view.header.elementCount > maxChunkValues || view.header.fpcSize > compressorDecompressor<T>::fpcBound(maxChunkValues))
+            throw std::runtime_error("Stream chunk holds more values than the chunk size allows");
+        bool continued = view.header.flags & frameFlagContinued;
+        if (continued != started)
+            throw std::runtime_error("Stream chunk is out of sequence");
+        predictorSet predictors = predictorSetFromCode(view.header.predictors);
+        unsigned tableBits = frameTableBits(view.header.tableBits);
+        if (!continued)
+        {
+            codec->setPredictorSet(predictors);
+            codec->setTableBits(tableBits);
+            codec->reset();
+        }
+        else if (predictors != codec->getPredictorSet() || tableBits != codec->getTableBits())
+            throw std::runtime_error("Stream chunk switches predictor set or table size");
+        started = true;
+
+        std::vector<uint8_t> fpcBytes = decodeFrameFpc(view);
+        decoded.resize(view.header.elementCount);
+        codec->decodeValues(fpcBytes.data(), fpcBytes.size(), decoded.size(), decoded.data());
+        position = 0;
+        return true;
+    }
+
+    template <typename T>
+    size_t StreamDecompressor<T>::pull(T *values, size_t count)
+    {
+        size_t written = 0;
+        while (written < count)
+        {
+            if (position == decoded.size() && !nextChunk())
+                break;
+
+            size_t take = std::min(count - written, decoded.size() - position);
+            std::copy(decoded.begin() + position, decoded.begin() + position + take, values + written);
+            position += take;
+            written += take;
+        }
+        return written;
+    }
+
+    template class StreamCompressor<float>;
+    template class StreamCompressor<double>;
+    template class StreamCompressor<uint32_t>;
+    template class StreamCompressor<uint64_t>;
+    template class StreamDecompressor<float>;
+    template class StreamDecompressor<double>;
+    template class StreamDecompressor<uint32_t>;
+    template class StreamDecompressor<uint64_t>;
+}
@@ -0,0 +1,499 @@
+#include "tableFile.hpp"
+#include "frameFormat.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <set>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace compression
+{
+    static constexpr size_t tableHeaderSize = 6, tableTrailerSize = 8;
+
+    template <typename T>
+    static bool isMissing(T value)
+    {
+        if constexpr (std::is_floating_point_v<T>)
+            return value != value;
+        else
+            return false;
+    }
+
+    template <typename T>
+    static void writeValue(std::vector<uint8_t> &out, T value)
+    {
+        if constexpr (sizeof(T) == 4)
+        {
+            uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            writeU32(out, bits);
+        }
+        else
+        {
+            uint64_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            writeU32(out, (uint32_t)bits);
+            writeU32(out, (uint32_t)(bits >> 32));
+        }
+    }
+
+    template <typename T>
+    static T readValue(const uint8_t *&in, const uint8_t *end)
+    {
+        if ((size_t)(end - in) < sizeof(T))
+            throw std::runtime_error("Table footer is truncated");
+        T value;
+        if constexpr (sizeof(T) == 4)
+        {
+            uint32_t bits = readU32(in);
+            std::memcpy(&value, &bits, sizeof(bits));
+        }
+        else
+        {
+            uint64_t bits = readU32(in) | (uint64_t)readU32(in + 4) << 32;
+            std::memcpy(&value, &bits, sizeof(bits));
+        }
+        in += sizeof(T);
+        return value;
+    }
+
+    template <typename T>
+    static columnChunk<T> chunkStatistics(const std::vector<T> &values)
+    {
+        columnChunk<T> chunk;
+        for (T value : values)
+        {
+            if (isMissing(value))
+                continue;
+            if (chunk.count == 0 || value < chunk.min)
+                chunk.min = value;
+            if (chunk.count == 0 || value > chunk.max)
+                chunk.max = value;
+            chunk.count++;
+        }
+        return chunk;
+    }
+
+    template <typename T>
+    TableWriter<T>::TableWriter(const std::string &path, const std::vector<std::string> &columnNames, size_t rowGroupRows,
+                                ThreadPool *pool)
+        : path(path), names(columnNames), rowGroupRows(rowGroupRows), pool(pool)
+    {
+        if (names.empty())
+            throw std::invalid_argument("Table needs at least one column");
+        if (std::any_of(names.begin(), names.end(), [](const std::string &name) { return name.empty(); }))
+            throw std::invalid_argument("Table column names must not be empty");
+        if (std::set<std::string>(names.begin(), names.end()).size() != names.size())
+            throw std::invalid_argument("Table column names must be unique");
+        if (rowGroupRows == 0)
+            throw std::invalid_argument("Table row groups need at least one row");
+
+        if (!this->pool)
+        {
+            ownedPool = std::make_unique<ThreadPool>();
+            this->pool = ownedPool.get();
+        }
+        for (size_t column = 0; column < names.size(); column++)
+            codecs.push_back(std::make_unique<compressorDecompressor<T>>());
+        buffered.resize(names.size());
+        frames.resize(names.size());
+        for (auto &values : buffered)
+            values.reserve(rowGroupRows);
+
+        file.open(path, std::ios::binary | std::ios::trunc);
+        if (!file)
+            throw std::runtime_error("Could not open " + path + ": " + std::strerror(errno));
+        std::vector<uint8_t> header;
+        writeU32(header, tableMagic);
+        header.push_back(tableVersion);
+        header.push_back(valueTypeCode<T>::value);
+        writeBytes(header.data(), header.size());
+    }
+
+    template <typename T>
+    TableWriter<T>::~TableWriter()
+    {
+        if (finished)
+            return;
+        try
+        {
+            finish();
+        }
+        catch (...)
+        {
+        }
+    }
+
+    template <typename T>
+    void TableWriter<T>::setEntropyBackend(entropyBackend backend)
+    {
+        for (auto &codec : codecs)
+            codec->setEntropyBackend(backend);
+    }
+
+    template <typename T>
+    void TableWriter<T>::setPredictorSet(predictorSet predictors)
+    {
+        for (auto &codec : codecs)
+            codec->setPredictorSet(predictors);
+    }
+
+    template <typename T>
+    void TableWriter<T>::setTableBits(unsigned tableBits)
+    {
+        for (auto &codec : codecs)
+            codec->setTableBits(tableBits);
+    }
+
+    template <typename T>
+    void TableWriter<T>::append(const std::vector<std::vector<T>> &columns)
+    {
+        if (finished)
+            throw std::invalid_argument("Table " + path + " is already finished");
+        if (columns.size() != names.size())
+            throw std::invalid_argument("Table rows need one column per name");
+        size_t rows = columns[0].size();
+        if (std::any_of(columns.begin(), columns.end(), [&](const std::vector<T> &values) { return values.size() != rows; }))
+            throw std::invalid_argument("Table columns must have the same length");
+
+        size_t offset = 0;
+        while (offset < rows)
+        {
+            size_t take = std::min(rows - offset, rowGroupRows - buffered[0].size());
+            for (size_t column = 0; column < names.size(); column++)
+                buffered[column].insert(buffered[column].end(), columns[column].begin() + offset,
+                                        columns[column].begin() + offset + take);
+            offset += take;
+            if (buffered[0].size() == rowGroupRows)
+                writeRowGroup(rowGroupRows);
+        }
+    }
+
+    template <typename T>
+    void TableWriter<T>::writeRowGroup(size_t rows)
+    {
+        rowGroupEntry<T> group;
+        group.firstRow = rowsWritten;
+        group.rowCount = rows;
+        group.chunks.resize(names.size());
+
+        pool->parallelFor(names.size(), [&](size_t column) {
+            std::vector<uint8_t> &frame = frames[column];
+            frame.resize(codecs[column]->compressBound(rows));
+            frame.resize(codecs[column]->compress(buffered[column].data(), rows, frame.data(), frame.size()));
+            group.chunks[column] = chunkStatistics(buffered[column]);
+        });
+
+        for (size_t column = 0; column < names.size(); column++)
+        {
+            group.chunks[column].offset = fileSize;
+            group.chunks[column].size = frames[column].size();
+            writeBytes(frames[column].data(), frames[column].size());
+            buffered[column].clear();
+        }
+        rowGroups.push_back(std::move(group));
+        rowsWritten += rows;
+    }
+
+    template <typename T>
+    void TableWriter<T>::writeBytes(const uint8_t *data, size_t size)
+    {
+        file.write(reinterpret_cast<const char *>(data), size);
+        if (!file)
+            throw std::runtime_error("Could not write " + path);
+        fileSize += size;
+    }
+
+    template <typename T>
+    void TableWriter<T>::finish()
+    {
+        if (finished)
+            return;
+        finished = true;
+        if (!buffered[0].empty())
+            writeRowGroup(buffered[0].size());
+
+        std::vector<uint8_t> footer;
+        writeVarint(footer, names.size());
+        for (const auto &name : names)
+        {
+            writeVarint(footer, name.size());
+            footer.insert(footer.end(), name.begin(), name.end());
+        }
+        writeVarint(footer, rowGroups.size());
+        for (const auto &group : rowGroups)
+        {
+            writeVarint(footer, group.rowCount);
+            for (const auto &chunk : group.chunks)
+            {
+                writeVarint(footer, chunk.size);
+                writeVarint(footer, chunk.count);
+                writeValue(footer, chunk.min);
+                writeValue(footer, chunk.max);
+            }
+        }
+        writeU32(footer, crc32(footer.data(), footer.size()));
+        writeU32(footer, (uint32_t)footer.size());
+        writeU32(footer, tableMagic);
+        writeBytes(footer.data(), footer.size());
+
+        file.close();
+        if (!file)
+            throw std::runtime_error("Could not write " + path);
+    }
+
+    template <typename T>
+    TableReader<T>::TableReader(const std::string &path) : path(path)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Could not open " + path + ": " + std::strerror(errno));
+        struct stat info;
+        if (fstat(fd, &info) != 0)
+        {
+            int error = errno;
+            close(fd);
+            throw std::runtime_error("Could not stat " + path + ": " + std::strerror(error));
+        }
+        size = info.st_size;
+        if (size > 0)
+        {
+            void *mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+            int error = errno;
+            close(fd);
+            if (mapping == MAP_FAILED)
+                throw std::runtime_error("Could not map " + path + ": " + std::strerror(error));
+            data = static_cast<const uint8_t *>(mapping);
+        }
+        else
+            close(fd);
+
+        try
+        {
+            readFooter();
+        }
+        catch (...)
+        {
+            if (data)
+                munmap(const_cast<uint8_t *>(data), size);
+            throw;
+        }
+    }
+
+    template <typename T>
+    TableReader<T>::~TableReader()
+    {
+        if (data)
+            munmap(const_cast<uint8_t *>(data), size);
+    }
+
+    template <typename T>
+    void TableReader<T>::readFooter()
+    {
+        if (size < tableHeaderSize + tableTrailerSize || readU32(data) != tableMagic || readU32(data + size - 4) != tableMagic)
+            throw std::runtime_error("Not an FPC table: " + path);
+        if (data[4] != tableVersion)
+            throw std::runtime_error("Unsupported table version: " + path);
+        if (data[5] != valueTypeCode<T>::value)
+            throw std::runtime_error("Table " + path + " holds another value type");
+
+        size_t footerSize = readU32(data + size - tableTrailerSize);
+        if (footerSize < 4 || footerSize > size - tableHeaderSize - tableTrailerSize)
+            throw std::runtime_error("Table footer size is out of range: " + path);
+        const uint8_t *footer = data + size - tableTrailerSize - footerSize;
+        const uint8_t *end = footer + footerSize - 4;
+        if (readU32(end) != crc32(footer, footerSize - 4))
+            throw std::runtime_error("Table footer checksum mismatch: " + path);
+
+        const uint8_t *in = footer;
+        uint64_t columnCount = readVarint(in, end);
+        if (columnCount == 0 || columnCount > footerSize)
+            throw std::runtime_error("Table footer is inconsistent: " + path);
+        names.resize(columnCount);
+        for (auto &name : names)
+        {
+            uint64_t nameLength = readVarint(in, end);
+            if (nameLength > (uint64_t)(end - in))
+                throw std::runtime_error("Table footer is truncated: " + path);
+            name.assign(reinterpret_cast<const char *>(in), nameLength);
+            in += nameLength;
+        }
+
+        uint64_t groupCount = readVarint(in, end);
+        if (groupCount > footerSize)
+            throw std::runtime_error("Table footer is inconsistent: " + path);
+        groups.resize(groupCount);
+        uint64_t offset = tableHeaderSize, firstRow = 0;
+        const uint64_t chunksEnd = footer - data;
+        for (auto &group : groups)
+        {
+            group.firstRow = firstRow;
+            group.rowCount = readVarint(in, end);
+            firstRow += group.rowCount;
+            group.chunks.resize(columnCount);
+            for (auto &chunk : group.chunks)
+            {
+                chunk.size = readVarint(in, end);
+                chunk.count = readVarint(in, end);
+                chunk.min = readValue<T>(in, end);
+                chunk.max = readValue<T>(in, end);
+                if (chunk.size > chunksEnd - offset || chunk.count > group.rowCount)
+                    throw std::runtime_error("Table footer is inconsistent: " + path);
+                chunk.offset = offset;
+                offset += chunk.size;
+            }
+        }
+        if (in != end || offset != chunksEnd)
+            throw std::runtime_error("Table footer does not match its length: " + path);
+    }
+
+    template <typename T>
+    size_t TableReader<T>::columnIndex(const std::string &name) const
+    {
+        auto it = std::find(names.begin(), names.end(), name);
+        if (it == names.end())
+            throw std::out_of_range("No column named " + name + " in " + path);
+        return it - names.begin();
+    }
+
+    template <typename T>
+    void TableReader<T>::decodeChunk(compressorDecompressor<T> &codec, size_t rowGroup, size_t column, std::vector<T> &values) const
+    {
+        const rowGroupEntry<T> &group = groups.at(rowGroup);
+        const columnChunk<T> &chunk = group.chunks.at(column);
+        values.resize(group.rowCount);
+        if (codec.decompress(data + chunk.offset, chunk.size, values.data(), values.size()) != group.rowCount)
+            throw std::runtime_error("Table chunk decoded to an unexpected length: " + path);
+    }
+
+    template <typename T>
+    std::vector<T> TableReader<T>::chunk(size_t rowGroup, size_t column) const
+    {
+        compressorDecompressor<T> codec;
+        std::vector<T> values;
+        decodeChunk(codec, rowGroup, column, values);
+        return values;
+    }
+
+    template <typename T>
+    std::vector<T> TableReader<T>::column(const std::string &name) const
+    {
+        size_t index = columnIndex(name);
+        compressorDecompressor<T> codec;
+        std::vector<T> values(rowCount()), chunkValues;
+        for (size_t group = 0; group < groups.size(); group++)
+        {
+            decodeChunk(codec, group, index, chunkValues);
+            std::copy(chunkValues.begin(), chunkValues.end(), values.begin() + groups[group].firstRow);
+        }
+        return values;
+    }
+
+    template <typename T>
+    std::vector<size_t> TableReader<T>::candidateRowGroups(const std::vector<rangePredicate<T>> &predicates) const
+    {
+        std::vector<size_t> predicateColumns;
+        for (const auto &predicate : predicates)
+            predicateColumns.push_back(columnIndex(predicate.column));
+
+        std::vector<size_t> candidates;
+        for (size_t group = 0; group < groups.size(); group++)
+        {
+            bool possible = true;
+            for (size_t i = 0; i < predicates.size() && possible; i++)
+            {
+                const columnChunk<T> &chunk = groups[group].chunks[predicateColumns[i]];
+                possible = chunk.count > 0 && predicates[i].lower <= chunk.max && chunk.min <= predicates[i].upper;
+            }
+            if (possible)
+                candidates.push_back(group);
+        }
+        return candidates;
+    }
+
+    template <typename T>
+    std::vector<std::vector<T>> TableReader<T>::scan(const std::vector<std::string> &columns,
+                                                     const std::vector<rangePredicate<T>> &predicates) const
+    {
+        std::vector<size_t> projected, predicateColumns;
+        for (const auto &name : columns)
+            projected.push_back(columnIndex(name));
+        for (const auto &predicate : predicates)
+            predicateColumns.push_back(columnIndex(predicate.column));
+
+        compressorDecompressor<T> codec;
+        std::vector<std::vector<T>> decoded(names.size());
+        std::vector<bool> isDecoded(names.size());
+        std::vector<uint8_t> matches;
+        std::vector<std::vector<T>> result(columns.size());
+
+        for (size_t group : candidateRowGroups(predicates))
+        {
+            std::fill(isDecoded.begin(), isDecoded.end(), false);
+            auto decodedColumn = [&](size_t column) -> const std::vector<T> & {
+                if (!isDecoded[column])
+                {
+                    decodeChunk(codec, group, column, decoded[column]);
+                    isDecoded[column] = true;
+                }
+                return decoded[column];
+            };
+
+            size_t rows = groups[group].rowCount;
+            matches.assign(rows, 1);
+            for (size_t i = 0; i < predicates.size(); i++)
+            {
+                const std::vector<T> &values = decodedColumn(predicateColumns[i]);
+                for (size_t row = 0; row < rows; row++)
+                    matches[row] &= predicates[i].lower <= values[row] && values[row] <= predicates[i].upper;
+            }
+
+            size_t matching = std::count(matches.begin(), matches.end(), 1);
+            if (matching == 0)
+                continue;
+            for (size_t i = 0; i < columns.size(); i++)
+            {
+                const std::vector<T> &values = decodedColumn(projected[i]);
+                if (matching == rows)
+                {
+                    result[i].insert(result[i].end(), values.begin(), values.end());
+                    continue;
+                }
+                for (size_t row = 0; row < rows; row++)
+                {
+                    if (matches[row])
+                        result[i].push_back(values[row]);
+                }
+            }
+        }
+        return result;
+    }
+
+    void appendCsv(TableWriter<float> &writer, const MappedCSVReader &csv)
+    {
+        std::vector<std::string> header = csv.header();
+        std::vector<size_t> columnIndices;
+        for (const auto &name : writer.columnNames())
+        {
+            auto it = std::find(header.begin(), header.end(), name);
+            if (it == header.end())
+                throw std::out_of_range("No column named " + name + " in the CSV header");
+            columnIndices.push_back(it - header.begin());
+        }
+        writer.append(csv.readFloatRows(columnIndices));
+    }
+
+    template class TableWriter<float>;
+    template class TableWriter<double>;
+    template class TableWriter<uint32_t>;
+    template class TableWriter<uint64_t>;
+
+    template class TableReader<float>;
+    template class TableReader<double>;
+    template class TableReader<uint32_t>;
+    template class TableReader<uint64_t>;
+}
@@ -0,0 +1,153 @@
+#include "threadPool.hpp"
+#include <exception>
+
+namespace compression
+{
+    ThreadPool::ThreadPool(size_t threads)
+    {
+        if (threads == 0)
+            threads = 1;
+
+        for (size_t i = 0; i < threads; i++)
+            queues.push_back(std::make_unique<taskQueue>());
+        for (size_t i = 0; i < threads; i++)
+            workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> guard(wakeLock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto &worker : workers)
+            worker.join();
+    }
+
+    // The pool whose worker runs on this thread, if any.
+    static thread_local const ThreadPool *currentPool = nullptr;
+
+    void ThreadPool::submit(std::function<void()> task)
+    {
+        size_t target = nextQueue++ % queues.size();
+        {
+            // Counted before it can be popped, so pending never wraps below zero.
+            std::lock_guard<std::mutex> guard(queues[target]->lock);
+            pending++;
+            queues[target]->tasks.push_back(std::move(task));
+        }
+        // A worker checks pending under wakeLock, so taking it here means the
+        // notification cannot fall between its check and its wait.
+        {
+            std::lock_guard<std::mutex> guard(wakeLock);
+        }
+        wake.notify_one();
+    }
+
+    bool ThreadPool::popTask(size_t self, std::function<void()> &task)
+    {
+        {
+            taskQueue &own = *queues[self];
+            std::lock_guard<std::mutex> guard(own.lock);
+            if (!own.tasks.empty())
+            {
+                task = std::move(own.tasks.front());
+                own.tasks.pop_front();
+                return true;
+            }
+        }
+
+        for (size_t i = 1; i < queues.size(); i++)
+        {
+            taskQueue &victim = *queues[(self + i) % queues.size()];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.tasks.empty())
+            {
+                task = std::move(victim.tasks.back());
+                victim.tasks.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void ThreadPool::workerLoop(size_t self)
+    {
+        currentPool = this;
+        for (;;)
+        {
+            std::function<void()> task;
+            if (popTask(self, task))
+            {
+                pending--;
+                task();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> guard(wakeLock);
+            wake.wait(guard, [this] { return stopping || pending > 0; });
+            if (stopping && pending == 0)
+                return;
+        }
+    }
+
+    void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)> &task)
+    {
+        if (count == 0)
+            return;
+
+        // A worker waiting on its own pool could hold up the very tasks it
+        // waits for, so nested calls run inline.
+        if (currentPool == this)
+        {
+            std::exception_ptr failure;
+            for (size_t i = 0; i < count; i++)
+            {
+                try
+                {
+                    task(i);
+                }
+                catch (...)
+                {
+                    if (!failure)
+                        failure = std::current_exception();
+                }
+            }
+            if (failure)
+                std::rethrow_exception(failure);
+            return;
+        }
+
+        std::mutex doneLock;
+        std::condition_variable done;
+        size_t remaining = count;
+        std::exception_ptr failure;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            submit([&, i] {
+                std::exception_ptr error;
+                try
+                {
+                    task(i);
+                }
+                catch (...)
+                {
+                    error = std::current_exception();
+                }
+
+                std::lock_guard<std::mutex> guard(doneLock);
+                if (error && !failure)
+                    failure = error;
+                if (--remaining == 0)
+                    done.notify_all();
+            });
+        }
+
+        std::unique_lock<std::mutex> guard(doneLock);
+        done.wait(guard, [&] { return remaining == 0; });
+        if (failure)
+            std::rethrow_exception(failure);
+    }
+}
@@ -0,0 +1,221 @@
+#include "xorCodec.hpp"
+#include <cstring>
+#include <stdexcept>
+
+namespace compression
+{
+    // Bits go into a 64-bit accumulator and leave it 32 at a time.
+    class bitWriter
+    {
+        uint8_t *out;
+        uint64_t pending = 0;
+        unsigned used = 0;
+
+    public:
+        explicit bitWriter(uint8_t *out) : out(out) {}
+
+        // At most 32 bits, `bits` clear above them.
+        void put(uint64_t bits, unsigned count)
+        {
+            pending |= bits << used;
+            used += count;
+            if (used >= 32)
+            {
+                uint32_t word = (uint32_t)pending;
+                std::memcpy(out, &word, 4);
+                out += 4;
+                pending >>= 32;
+                used -= 32;
+            }
+        }
+
+        void putWide(uint64_t bits, unsigned count)
+        {
+            if (count > 32)
+            {
+                put(bits & 0xffffffffu, 32);
+                put(bits >> 32, count - 32);
+            }
+            else
+                put(bits, count);
+        }
+
+        uint8_t *finish()
+        {
+            for (; used > 0; used = used > 8 ? used - 8 : 0)
+            {
+                *out++ = (uint8_t)pending;
+                pending >>= 8;
+            }
+            return out;
+        }
+    };
+
+    class bitReader
+    {
+        const uint8_t *in;
+        const uint8_t *end;
+        uint64_t pending = 0;
+        unsigned available = 0;
+
+    public:
+        bitReader(const uint8_t *in, const uint8_t *end) : in(in), end(end) {}
+
+        // At most 32 bits.
+        uint64_t get(unsigned count)
+        {
+            if (available < count)
+            {
+                size_t bytes = std::min<size_t>(4, end - in);
+                if (bytes == 0)
+                    throw std::runtime_error("XOR stream is truncated");
+                uint32_t word = 0;
+                std::memcpy(&word, in, bytes);
+                in += bytes;
+                pending |= (uint64_t)word << available;
+                available += 32;
+            }
+            uint64_t bits = pending & ((1ull << count) - 1);
+            pending >>= count;
+            available -= count;
+            return bits;
+        }
+
+        uint64_t getWide(unsigned count)
+        {
+            if (count > 32)
+            {
+                uint64_t low = get(32);
+                return low | get(count - 32) << 32;
+            }
+            return get(count);
+        }
+    };
+
+    template <typename T>
+    struct xorLayout
+    {
+        using word = typename fpcTraits<T>::word;
+        static constexpr unsigned wordBits = fpcTraits<T>::wordBits;
+        static constexpr unsigned leadingBits = 5;
+        static constexpr unsigned maxLeading = 31;
+        static constexpr unsigned lengthBits = wordBits == 64 ? 6 : 5;
+    };
+
+    template <typename T>
+    size_t xorBound(size_t count)
+    {
+        using layout = xorLayout<T>;
+        return (count * (2 + layout::leadingBits + layout::lengthBits + layout::wordBits) + 7) / 8 + 8;
+    }
+
+    template <typename T>
+    size_t xorEncode(const T *input, size_t count, uint8_t *output)
+    {
+        using layout = xorLayout<T>;
+        using word = typename layout::word;
+        if (count == 0)
+            return 0;
+
+        bitWriter writer(output);
+        word previous;
+        std::memcpy(&previous, &input[0], sizeof(T));
+        writer.putWide(previous, layout::wordBits);
+
+        // No value has more leading zeros than the word, so the first non-zero
+        // XOR always opens a window.
+        unsigned windowLeading = layout::wordBits, windowTrailing = 0;
+        for (size_t i = 1; i < count; i++)
+        {
+            word current;
+            std::memcpy(&current, &input[i], sizeof(T));
+            word x = current ^ previous;
+            previous = current;
+            if (x == 0)
+            {
+                writer.put(0, 1);
+                continue;
+            }
+
+            unsigned leading, trailing;
+            if constexpr (layout::wordBits == 64)
+            {
+                leading = __builtin_clzll(x);
+                trailing = __builtin_ctzll(x);
+            }
+            else
+            {
+                leading = __builtin_clz(x);
+                trailing = __builtin_ctz(x);
+            }
+            if (leading > layout::maxLeading)
+                leading = layout::maxLeading;
+
+            if (leading >= windowLeading && trailing >= windowTrailing)
+            {
+                writer.put(0x1, 2);
+                writer.putWide(x >> windowTrailing, layout::wordBits - windowLeading - windowTrailing);
+            }
+            else
+            {
+                unsigned length = layout::wordBits - leading - trailing;
+                writer.put(0x3 | leading << 2 | (uint64_t)(length - 1) << (2 + layout::leadingBits),
+                           2 + layout::leadingBits + layout::lengthBits);
+                writer.putWide(x >> trailing, length);
+                windowLeading = leading;
+                windowTrailing = trailing;
+            }
+        }
+        return writer.finish() - output;
+    }
+
+    template <typename T>
+    void xorDecode(const uint8_t *input, size_t size, size_t count, T *output)
+    {
+        using layout = xorLayout<T>;
+        using word = typename layout::word;
+        if (count == 0)
+            return;
+
+        bitReader reader(input, input + size);
+        word previous = (word)reader.getWide(layout::wordBits);
+        std::memcpy(&output[0], &previous, sizeof(T));
+
+        unsigned windowLeading = 0, windowTrailing = 0;
+        bool window = false;
+        for (size_t i = 1; i < count; i++)
+        {
+            if (reader.get(1))
+            {
+                if (reader.get(1))
+                {
+                    windowLeading = (unsigned)reader.get(layout::leadingBits);
+                    unsigned length = (unsigned)reader.get(layout::lengthBits) + 1;
+                    if (windowLeading + length > layout::wordBits)
+                        throw std::runtime_error("XOR stream has a bad bit window");
+                    windowTrailing = layout::wordBits - windowLeading - length;
+                    window = true;
+                }
+                else if (!window)
+                    throw std::runtime_error("XOR stream reuses a window before opening one");
+                previous ^= (word)reader.getWide(layout::wordBits - windowLeading - windowTrailing) << windowTrailing;
+            }
+            std::memcpy(&output[i], &previous, sizeof(T));
+        }
+    }
+
+    template size_t xorBound<float>(size_t);
+    template size_t xorBound<double>(size_t);
+    template size_t xorBound<uint32_t>(size_t);
+    template size_t xorBound<uint64_t>(size_t);
+
+    template size_t xorEncode(const float *, size_t, uint8_t *);
+    template size_t xorEncode(const double *, size_t, uint8_t *);
+    template size_t xorEncode(const uint32_t *, size_t, uint8_t *);
+    template size_t xorEncode(const uint64_t *, size_t, uint8_t *);
+
+    template void xorDecode(const uint8_t *, size_t, size_t, float *);
+    template void xorDecode(const uint8_t *, size_t, size_t, double *);
+    template void xorDecode(const uint8_t *, size_t, size_t, uint32_t *);
+    template void xorDecode(const uint8_t *, size_t, size_t, uint64_t *);
+}